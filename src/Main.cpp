@@ -19,6 +19,10 @@
 #include "vector.h"
 #include "render.h"
 #include "polygon.h"
+#include "lunar_data.h"
+#include "terrain_file.h"
+#include "terrain_pager.h"
+#include "texture_pyramid.h"
 
 using namespace std;
 
@@ -228,7 +232,47 @@ int main() {
     // Create views that user will see
     int currentView = 0;
     MenuView menuView(surf, currentView);
-    MainView mainView(surf);
+
+    // Use the real lunar south pole heights when the data file (or its cache)
+    // is available, and fall back to a synthetic surface when it isn't.
+    const std::string lunarDataFileName = "../data/fy20_adc_data_file_88_degrees.csv";
+    const std::string lunarCacheFileName = "../data/fy20_adc_data_file_88_degrees.terrain";
+
+    // Terrain that is too big to keep in memory is streamed in tiles from its
+    // cache, and a coarse overview of it stands in for collisions and physics.
+    const int maxResidentSide = 1024;
+    std::unique_ptr<TerrainPager> terrainPager;
+    std::optional<Grid> lunarTerrain;
+    try {
+        TerrainFile cache(lunarCacheFileName);
+        const int side = std::max(cache.rows(), cache.columns());
+        // A stale cache is left for loadLunarTerrain() to rebuild first.
+        if (side > maxResidentSide && !cache.isStaleFor(lunarDataFileName)) {
+            // Compact tiles only need to be drawn, and far more of them fit.
+            terrainPager = std::make_unique<TerrainPager>(lunarCacheFileName, 64, 256 * 1024 * 1024, 2, 30,
+                                                          TileStorage::Compact);
+            lunarTerrain = Grid(cache, (side + maxResidentSide - 1) / maxResidentSide);
+        }
+    } catch (const std::runtime_error&) {
+        // There's no usable cache yet; loadLunarTerrain() will build one.
+    }
+    if (!lunarTerrain) {
+        lunarTerrain = loadLunarTerrain(lunarDataFileName, lunarCacheFileName);
+    }
+    const bool haveLunarTerrain = lunarTerrain.has_value();
+    MainView mainView(surf, haveLunarTerrain ? std::move(*lunarTerrain) : Grid(300, 300, 6.0));
+    mainView.setTerrainPager(terrainPager.get());
+
+    // The lunar surface texture is far too big to load whole, so the nav view
+    // draws it from a tiled pyramid made by altitution-pyramid.
+    const std::string lunarTextureFileName = "../data/fy20_adc_lunar_terrain_texture.pyramid";
+    std::unique_ptr<TextureTileCache> lunarMap;
+    try {
+        lunarMap = std::make_unique<TextureTileCache>(lunarTextureFileName);
+        mainView.setLunarMap(lunarMap.get());
+    } catch (const std::runtime_error& e) {
+        std::cout << "Not showing the lunar map: " << e.what() << "\n";
+    }
 
 
     // Kinematic variables
@@ -247,24 +291,32 @@ int main() {
 
     // 9.8 m/s^2 = x m/f * 30f/s
 
-    // sombrero. Ole!
-    mainView.getGrid().setHeightByFunction([&mainView] (double x_, double y_) {
-        double x = x_ * 20 - 10;
-        double y = y_ * 20 - 10;
-        double z = sin(sqrt(x*x + y*y)) / (sqrt(x*x + y*y));
-        z = z * mainView.getGrid().cellSize() * sqrt(mainView.getGrid().rows() * mainView.getGrid().columns()) * .5;
-        // return 0;
-        return z;
-    }, [] (double x_, double y_) {
-        uint8_t x = static_cast<uint8_t>(x_ * 255);
-        uint8_t y = static_cast<uint8_t>(y_ * 255);
-        uint8_t squarert = static_cast<uint8_t>(sqrt(x_ * y_) * 255);
-        return SDL_Color{x, y, squarert, 255};
-    });
+    if (!haveLunarTerrain) {
+        // sombrero. Ole!
+        mainView.getGrid().setHeightByFunction([&mainView] (double x_, double y_) {
+            double x = x_ * 20 - 10;
+            double y = y_ * 20 - 10;
+            double z = sin(sqrt(x*x + y*y)) / (sqrt(x*x + y*y));
+            z = z * mainView.getGrid().cellSize() * sqrt(mainView.getGrid().rows() * mainView.getGrid().columns()) * .5;
+            // return 0;
+            return z;
+        }, [] (double x_, double y_) {
+            uint8_t x = static_cast<uint8_t>(x_ * 255);
+            uint8_t y = static_cast<uint8_t>(y_ * 255);
+            uint8_t squarert = static_cast<uint8_t>(sqrt(x_ * y_) * 255);
+            return SDL_Color{x, y, squarert, 255};
+        });
+    }
 
     // Matrix gridRotationMatrix = rotationMatrix(mainView.getGrid().system().center, Point {7,49,7}, 75);
     // mainView.getGrid().apply(gridRotationMatrix);
 
+    // Kept across frames so that its depth buffer is only allocated once.
+    Renderer sceneRenderer;
+
+    // The pager's change count as of the last frame drawn.
+    size_t drawnPagerChanges = 0;
+
     while (currentView >= 0) {
         redraw = false;
         SDL_Event event;
@@ -275,6 +327,14 @@ int main() {
                     currentView = -1;
                     break;
                 case SDL_KEYDOWN:
+                    // Tab cycles the terrain through filled, wireframe and point drawing.
+                    if (event.key.keysym.sym == SDLK_TAB && !pressedKeys[SDLK_TAB] && currentView == 1) {
+                        const RenderStyle style = sceneRenderer.getStyle();
+                        sceneRenderer.setStyle(style == RenderStyle::Filled ? RenderStyle::Wireframe :
+                                               style == RenderStyle::Wireframe ? RenderStyle::Points :
+                                               RenderStyle::Filled);
+                        redraw = true;
+                    }
                     pressedKeys[event.key.keysym.sym] = true;
                     break;
                 case SDL_KEYUP:
@@ -433,6 +493,9 @@ int main() {
         yawDeg -= currentTurningRate;
 
         mainView.setCamera(camera);
+        if (terrainPager) {
+            terrainPager->update(camera.center, velocity);
+        }
 
         velocity *= frictionDecay;
         currentTurningRate *= turningFrictionDecay;
@@ -440,13 +503,25 @@ int main() {
         if (velocity.magnitude() > 0 || abs(currentTurningRate) > 0 || verticalMotion.magnitude() > 0) {
             redraw = true;
         }
+        // Draw tiles as the pager loads and evicts them, even while the
+        // camera is still.
+        if (terrainPager && currentView == 1) {
+            const size_t pagerChanges = terrainPager->changeCount();
+            if (pagerChanges != drawnPagerChanges) {
+                drawnPagerChanges = pagerChanges;
+                redraw = true;
+            }
+        }
+        // Keep polling until the menu's background image has been decoded.
+        if (currentView == 0 && menuView.loading()) {
+            redraw = true;
+        }
         if (redraw) {
             if (currentView == 0) {
                 menuView.draw(surf);
             } else if (currentView == 1) {
-                Renderer r;
-                r.prepare(surf, renderer, mainView.getRenderBoundary(), camera);
-                mainView.drawWithRenderer(r);
+                sceneRenderer.prepare(surf, renderer, mainView.getRenderBoundary(), camera);
+                mainView.drawWithRenderer(sceneRenderer);
 
             }
 
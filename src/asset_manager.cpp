@@ -2,19 +2,35 @@
 #include <stdexcept>
 #include "SDL_image.h"
 
-// Font manager constructor
-AssetManager::AssetManager() {
-      TTF_Font* font = TTF_OpenFont("../fonts/Gidole-Regular.ttf", 48);
-      if (!font) {
-          printf("TTF_OpenFont: %s\n", TTF_GetError());
+namespace {
+      // The fonts we know about, by the names getFont() takes.
+      const std::map<std::string, std::string> fontFiles = {
+          {"gidole", "../fonts/Gidole-Regular.ttf"},
+          {"gidolinya", "../fonts/Gidolinya-Regular.otf"}
+      };
+      const int fontSize = 48;
+
+      std::shared_ptr<SDL_Surface> loadImage(const std::string& imagePath) {
+          SDL_Surface* image = IMG_Load(imagePath.c_str());
+          if (!image) {
+              throw std::runtime_error(IMG_GetError());
+          }
+          return std::shared_ptr<SDL_Surface>(image, SDL_FreeSurface);
       }
-      fontRegistry["gidole"] = font;
+}
 
-      font = TTF_OpenFont("../fonts/Gidolinya-Regular.otf", 48);
-      if (!font) {
-          printf("TTF_OpenFont: %s\n", TTF_GetError());
+// Asset manager constructor
+AssetManager::AssetManager() : stopping(false) {
+      imageLoader = std::thread(&AssetManager::imageLoaderLoop, this);
+}
+
+AssetManager::~AssetManager() {
+      {
+          std::lock_guard<std::mutex> guard(mutex);
+          stopping = true;
       }
-      fontRegistry["gidolinya"] = font;
+      imageRequested.notify_all();
+      imageLoader.join();
 }
 
 const AssetManager& getAssetManager() {
@@ -23,17 +39,123 @@ const AssetManager& getAssetManager() {
 }
 
 TTF_Font* AssetManager::getFont(std::string fontName) const {
-      if (fontRegistry.find(fontName) == fontRegistry.end()) {
+      std::lock_guard<std::mutex> guard(mutex);
+      auto iter = fontRegistry.find(fontName);
+      if (iter != fontRegistry.end()) {
+          return iter->second;
+      }
+
+      auto file = fontFiles.find(fontName);
+      if (file == fontFiles.end()) {
           throw std::runtime_error("Could not find " + fontName);
       }
-      return fontRegistry.find(fontName)->second;
+      TTF_Font* font = TTF_OpenFont(file->second.c_str(), fontSize);
+      if (!font) {
+          printf("TTF_OpenFont: %s\n", TTF_GetError());
+      }
+      fontRegistry[fontName] = font;
+      return font;
 }
 
-SDL_Surface* AssetManager::getImage(std::string imageFileName) const {
+const GlyphAtlas& AssetManager::getGlyphAtlas(std::string fontName) const {
+      {
+          std::lock_guard<std::mutex> guard(mutex);
+          auto iter = glyphAtlases.find(fontName);
+          if (iter != glyphAtlases.end()) {
+              return *iter->second;
+          }
+      }
+
+      // getFont() takes the lock itself.
+      auto atlas = std::make_unique<GlyphAtlas>(getFont(fontName));
+      std::lock_guard<std::mutex> guard(mutex);
+      auto& slot = glyphAtlases[fontName];
+      if (!slot) {
+          slot = std::move(atlas);
+      }
+      return *slot;
+}
+
+std::shared_ptr<SDL_Surface> AssetManager::getImage(std::string imageFileName) const {
       std::string imagePath = "../images/" + imageFileName;
-      SDL_Surface* image = IMG_Load(imagePath.c_str());
-      if (!image) {
-          throw std::runtime_error(IMG_GetError());
+      std::shared_future<std::shared_ptr<SDL_Surface>> pending;
+      {
+          std::lock_guard<std::mutex> guard(mutex);
+          if (auto image = imageCache[imagePath].lock()) {
+              return image;
+          }
+          auto iter = pendingImages.find(imagePath);
+          if (iter != pendingImages.end()) {
+              pending = iter->second;
+          }
+      }
+      if (pending.valid()) {
+          // Someone already asked for it; wait for the loader thread rather
+          // than decoding it twice.
+          return pending.get();
       }
+
+      std::shared_ptr<SDL_Surface> image = loadImage(imagePath);
+      std::lock_guard<std::mutex> guard(mutex);
+      if (auto cached = imageCache[imagePath].lock()) {
+          // The loader thread finished the same image while we were decoding.
+          return cached;
+      }
+      imageCache[imagePath] = image;
       return image;
 }
+
+std::shared_future<std::shared_ptr<SDL_Surface>> AssetManager::requestImage(std::string imageFileName) const {
+      std::string imagePath = "../images/" + imageFileName;
+      std::promise<std::shared_ptr<SDL_Surface>> promise;
+      std::shared_future<std::shared_ptr<SDL_Surface>> result = promise.get_future().share();
+      {
+          std::lock_guard<std::mutex> guard(mutex);
+          if (auto image = imageCache[imagePath].lock()) {
+              promise.set_value(image);
+              return result;
+          }
+          auto iter = pendingImages.find(imagePath);
+          if (iter != pendingImages.end()) {
+              return iter->second;
+          }
+          pendingImages[imagePath] = result;
+          imageQueue.emplace_back(imagePath, std::move(promise));
+      }
+      imageRequested.notify_one();
+      return result;
+}
+
+void AssetManager::imageLoaderLoop() {
+      while (true) {
+          std::pair<std::string, std::promise<std::shared_ptr<SDL_Surface>>> request;
+          {
+              std::unique_lock<std::mutex> guard(mutex);
+              imageRequested.wait(guard, [this] { return stopping || !imageQueue.empty(); });
+              if (stopping) {
+                  // Whoever is still waiting on the queued images gets a
+                  // broken_promise from their future.
+                  return;
+              }
+              request = std::move(imageQueue.front());
+              imageQueue.pop_front();
+          }
+
+          const std::string& imagePath = request.first;
+          try {
+              std::shared_ptr<SDL_Surface> image = loadImage(imagePath);
+              {
+                  std::lock_guard<std::mutex> guard(mutex);
+                  imageCache[imagePath] = image;
+                  pendingImages.erase(imagePath);
+              }
+              request.second.set_value(image);
+          } catch (const std::runtime_error&) {
+              {
+                  std::lock_guard<std::mutex> guard(mutex);
+                  pendingImages.erase(imagePath);
+              }
+              request.second.set_exception(std::current_exception());
+          }
+      }
+}
@@ -1,18 +1,60 @@
 #ifndef ASSET_MANAGER_H_INCLUDED
 #define ASSET_MANAGER_H_INCLUDED
 
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include "SDL_ttf.h"
+#include "glyph_atlas.h"
 
 class AssetManager {
     private:
         AssetManager();
-        std::map<std::string, TTF_Font*> fontRegistry;
+        ~AssetManager();
+
+        // Fonts are opened the first time they are asked for.
+        mutable std::map<std::string, TTF_Font*> fontRegistry;
+
+        // Glyph atlases, made the first time each font is drawn with.
+        mutable std::map<std::string, std::unique_ptr<GlyphAtlas>> glyphAtlases;
+
+        // Every image that is still in use somewhere, keyed by path.  An image
+        // is freed as soon as the last shared_ptr to it goes away.
+        mutable std::map<std::string, std::weak_ptr<SDL_Surface>> imageCache;
+
+        // Images waiting for or being decoded by the loader thread, keyed by
+        // path, so that repeated requests share a single decode.
+        mutable std::map<std::string, std::shared_future<std::shared_ptr<SDL_Surface>>> pendingImages;
+        mutable std::deque<std::pair<std::string, std::promise<std::shared_ptr<SDL_Surface>>>> imageQueue;
+
+        mutable std::mutex mutex;
+        mutable std::condition_variable imageRequested;
+        bool stopping;
+        std::thread imageLoader;
+
+        void imageLoaderLoop();
     public:
         friend const AssetManager& getAssetManager();
         TTF_Font* getFont(std::string fontName) const;
-        SDL_Surface* getImage(std::string imageFileName) const;
+
+        // Returns the glyph atlas for a font.  Prefer drawing text with this
+        // over rendering it with SDL_ttf, especially if it changes often.
+        const GlyphAtlas& getGlyphAtlas(std::string fontName) const;
+
+        // Returns the image, decoding it first unless it is already in use.
+        // Throws std::runtime_error if the image can't be loaded.
+        std::shared_ptr<SDL_Surface> getImage(std::string imageFileName) const;
+
+        // Starts decoding the image on a background thread and returns
+        // immediately.  The future's get() throws std::runtime_error if the
+        // image couldn't be loaded.
+        std::shared_future<std::shared_ptr<SDL_Surface>> requestImage(std::string imageFileName) const;
 };
 
 extern const AssetManager& getAssetManager();
@@ -0,0 +1,144 @@
+// Times the terrain code paths that have a faster variant, and checks that
+// the variants agree.
+//
+// Usage: altitution-benchmark [benchmark]...
+//
+// With no arguments every benchmark is run.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "grid.h"
+#include "vector.h"
+
+using namespace std;
+
+namespace {
+    // Times Grid::floorHeights() against sampling the same points one at a
+    // time with floorHeight() and floorNormal(), and checks that they agree.
+    void benchmarkFloorSampling() {
+        Grid g(1000, 1000, 6.0);
+        g.setHeightByFunction([] (double x, double y) {
+            return 40 * sin(x * 37) * cos(y * 23);
+        });
+
+        const size_t samples = 1 << 20;
+        vector<double> u(samples), v(samples);
+        for (size_t i = 0; i < samples; i++) {
+            u[i] = (i * 7919 % samples) / double(samples);
+            v[i] = (i * 104729 % samples) / double(samples);
+        }
+        vector<double> scalarHeights(samples), batchHeights(samples);
+        vector<Vector> scalarNormals(samples), batchNormals(samples);
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < samples; i++) {
+            scalarHeights[i] = g.floorHeight(u[i], v[i]);
+            scalarNormals[i] = g.floorNormal(u[i], v[i]);
+        }
+        auto middle = chrono::steady_clock::now();
+        g.floorHeights(u.data(), v.data(), samples, batchHeights.data(), batchNormals.data());
+        auto end = chrono::steady_clock::now();
+
+        double largestDifference = 0;
+        for (size_t i = 0; i < samples; i++) {
+            largestDifference = max(largestDifference, abs(scalarHeights[i] - batchHeights[i]));
+            largestDifference = max(largestDifference, (scalarNormals[i] - batchNormals[i]).magnitude());
+        }
+        cout << samples << " samples\n"
+             << "  one at a time: " << chrono::duration<double, milli>(middle - start).count() << " ms\n"
+             << "  batched:       " << chrono::duration<double, milli>(end - middle).count() << " ms\n"
+             << "  largest difference: " << largestDifference << "\n";
+    }
+
+    // Times findFloor(), updateLattice() and castRays() with each lattice
+    // layout.
+    void benchmarkLatticeLayouts() {
+        Grid g(2000, 2000, 6.0);
+        g.setHeightByFunction([] (double x, double y) {
+            return 40 * sin(x * 37) * cos(y * 23);
+        });
+
+        const size_t samples = 1 << 20;
+        vector<double> u(samples), v(samples);
+        for (size_t i = 0; i < samples; i++) {
+            u[i] = (i * 7919 % samples) / double(samples);
+            v[i] = (i * 104729 % samples) / double(samples);
+        }
+        vector<Ray> rays;
+        for (size_t i = 0; i < 100000; i++) {
+            const Point target = g.findFloor(u[i], v[i]);
+            rays.push_back(Ray{target + Vector(300, 200, -150), Vector(-300, -200, 150)});
+        }
+
+        for (LatticeLayout layout : {LatticeLayout::RowMajor, LatticeLayout::Tiled}) {
+            g.setLatticeLayout(layout);
+
+            auto start = chrono::steady_clock::now();
+            double total = 0;
+            for (size_t i = 0; i < samples; i++) {
+                total += g.findFloor(u[i], v[i]).y;
+            }
+            auto floors = chrono::steady_clock::now();
+            g.updateLattice();
+            auto slopes = chrono::steady_clock::now();
+            size_t hits = 0;
+            for (const auto& hit : g.castRays(rays)) {
+                hits += hit.has_value();
+            }
+            auto end = chrono::steady_clock::now();
+
+            cout << (layout == LatticeLayout::RowMajor ? "row-major" : "tiled") << " lattice\n"
+                 << "  findFloor x " << samples << ": " << chrono::duration<double, milli>(floors - start).count() << " ms\n"
+                 << "  updateLattice: " << chrono::duration<double, milli>(slopes - floors).count() << " ms\n"
+                 << "  castRays x " << rays.size() << ": " << chrono::duration<double, milli>(end - slopes).count() << " ms"
+                 << " (" << hits << " hits, " << total << ")\n";
+        }
+    }
+
+    struct Benchmark {
+        const char* name;
+        void (*run)();
+    };
+
+    const Benchmark benchmarks[] = {
+        {"floor", benchmarkFloorSampling},
+        {"lattice", benchmarkLatticeLayouts},
+    };
+}
+
+int main(int argc, char* argv[]) {
+    auto selects = [&] (const Benchmark& benchmark, int i) {
+        return strcmp(argv[i], benchmark.name) == 0;
+    };
+    for (int i = 1; i < argc; i++) {
+        bool known = false;
+        for (const Benchmark& benchmark : benchmarks) {
+            known = known || selects(benchmark, i);
+        }
+        if (!known) {
+            cerr << "Unknown benchmark " << argv[i] << "; the benchmarks are:";
+            for (const Benchmark& benchmark : benchmarks) {
+                cerr << " " << benchmark.name;
+            }
+            cerr << "\n";
+            return 1;
+        }
+    }
+
+    for (const Benchmark& benchmark : benchmarks) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; i++) {
+            selected = selected || selects(benchmark, i);
+        }
+        if (selected) {
+            cout << "== " << benchmark.name << "\n";
+            benchmark.run();
+        }
+    }
+    return 0;
+}
@@ -8,16 +8,8 @@ ButtonView::ButtonView(SDL_Rect buttonBoundary, std::string buttonText, SDL_Colo
     buttonColor_ = buttonColor;
     borderColor_ = SDL_Color{55, 128, 189};
     callback_ = callback;
-    const AssetManager& am = getAssetManager();
-    TTF_Font* buttonFont = am.getFont("gidole");
-    renderText = TTF_RenderUTF8_Shaded(buttonFont, buttonText.c_str(), SDL_Color{0, 0, 0, 255}, buttonColor_);
-
 };
 
-ButtonView::~ButtonView() {
-    SDL_FreeSurface(renderText);
-}
-
 SDL_Rect ButtonView::boundary() const {
     return SDL_Rect {
       buttonBoundary_.x,
@@ -45,16 +37,11 @@ void ButtonView::draw(SDL_Surface* screen) {
     SDL_FillRect(screen, &innerButtonBoundary, SDL_MapRGB(screen->format, buttonColor_.r, buttonColor_.g, buttonColor_.b));
 
     // Draw the button text.
-    SDL_Rect rec = SDL_Rect{
-      buttonBoundary.x + buttonBoundary.w / 2 - renderText->w / 2 ,
-      buttonBoundary.y + buttonBoundary.h / 2 - renderText->h / 2,
-      0 /* ignored */,
-      0 /* ignored */
-    };
-    SDL_BlitSurface(renderText,
-                    nullptr,
-                    screen,
-                    &rec);
+    const GlyphAtlas& atlas = getAssetManager().getGlyphAtlas("gidole");
+    atlas.draw(screen, buttonText_,
+               buttonBoundary.x + buttonBoundary.w / 2 - atlas.textWidth(buttonText_) / 2,
+               buttonBoundary.y + buttonBoundary.h / 2 - atlas.lineHeight() / 2,
+               SDL_Color{0, 0, 0, 255});
 }
 
 void ButtonView::handleClicks(SDL_MouseButtonEvent& mouseButtonEvent) {
@@ -9,7 +9,6 @@
 class ButtonView : public View {
     public:
         ButtonView(SDL_Rect buttonBoundary, std::string buttonText, SDL_Color buttonColor, std::function<void()> callback);
-        ~ButtonView();
         void draw(SDL_Surface* screen);
         SDL_Rect boundary() const;
         void handleClicks(SDL_MouseButtonEvent& mouseButtonEvent);
@@ -19,7 +18,6 @@ class ButtonView : public View {
         std::string buttonText_;
         SDL_Color buttonColor_;
         SDL_Color borderColor_;
-        SDL_Surface* renderText;
         std::function<void()> callback_;
 };
 
@@ -0,0 +1,303 @@
+#include "compact_tile.h"
+#include "grid.h"
+#include "render.h"
+#include "terrain_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+    uint32_t packColor(SDL_Color color) {
+        return uint32_t(color.r) | uint32_t(color.g) << 8 | uint32_t(color.b) << 16 | uint32_t(color.a) << 24;
+    }
+
+    SDL_Color unpackColor(uint32_t color) {
+        return SDL_Color{Uint8(color), Uint8(color >> 8), Uint8(color >> 16), Uint8(color >> 24)};
+    }
+
+    const char* layerName(TileLayer layer) {
+        return layer == TileLayer::Slope ? "slope" : "temperature";
+    }
+
+    // What TilePointIterator points at: a lattice point rebuilt from the
+    // tile's packed arrays.
+    struct TilePoint {
+        Point position;
+        SDL_Color color;
+        operator Point() const { return position; }
+    };
+
+    // Walks every stride-th lattice point of every stride-th row of a tile.
+    class TilePointIterator {
+        public:
+            TilePointIterator(const CompactTile& tile, int stride, int row)
+                : tile_(tile), stride_(stride), row_(row), column_(0) {}
+
+            struct Arrow {
+                TilePoint point;
+                const TilePoint* operator->() const { return &point; }
+            };
+
+            TilePoint operator*() const {
+                return TilePoint{tile_.position(row_, column_), tile_.color(row_, column_)};
+            }
+            Arrow operator->() const { return Arrow{**this}; }
+            TilePointIterator& operator++() {
+                column_ += stride_;
+                if (column_ > tile_.columns()) {
+                    column_ = 0;
+                    row_ += stride_;
+                }
+                return *this;
+            }
+            bool operator!=(const TilePointIterator& other) const {
+                return row_ != other.row_ || column_ != other.column_;
+            }
+        private:
+            const CompactTile& tile_;
+            int stride_;
+            int row_, column_;
+    };
+}
+
+QuantizedLayer::QuantizedLayer() : offset(0), scale(1) {}
+
+void QuantizedLayer::assign(const double* source, size_t count) {
+    values.resize(count);
+    if (count == 0) {
+        return;
+    }
+    const auto [low, high] = minmax_element(source, source + count);
+    offset = *low;
+    scale = *high > *low ? (*high - *low) / 65535 : 1;
+    for (size_t i = 0; i < count; i++) {
+        values[i] = static_cast<uint16_t>(lround((source[i] - offset) / scale));
+    }
+}
+
+CompactTile::CompactTile(const TerrainFile& terrain, int row0, int column0, int rows, int columns,
+                         const vector<TileLayer>& layers)
+    : rows_(rows), columns_(columns), cellSize_(terrain.cellSize()),
+      triangleIndices_(Grid::rowMajorTriangleIndices(rows, columns)) {
+    for (TileLayer layer : layers) {
+        if (layer != TileLayer::Slope) {
+            throw runtime_error(string("Terrain caches don't store the ") + layerName(layer) + " layer");
+        }
+    }
+
+    const Basis system = terrain.system();
+    setSystem(Basis(system.center +
+                    (column0 + columns / 2.0 - terrain.columns() / 2.0) * cellSize_ * system.axisX +
+                    (row0 + rows / 2.0 - terrain.rows() / 2.0) * cellSize_ * system.axisZ,
+                    system.axisX, system.axisY, system.axisZ));
+
+    // The layers are quantized from a copy of the tile's part of the cache,
+    // since their scales depend on the whole tile.
+    const size_t points = static_cast<size_t>(rows + 1) * (columns + 1);
+    const size_t sourceColumns = terrain.columns() + 1;
+    vector<double> values(points);
+    auto gather = [&] (const float* source) {
+        for (int row = 0; row <= rows; row++) {
+            const float* sourceRow = source + (row0 + row) * sourceColumns + column0;
+            copy(sourceRow, sourceRow + columns + 1, values.begin() + latticeIndex(row, 0));
+        }
+    };
+    gather(terrain.heights());
+    heights_.assign(values.data(), points);
+    if (!layers.empty()) {
+        gather(terrain.slopes());
+        layers_[static_cast<int>(TileLayer::Slope)].emplace().assign(values.data(), points);
+    }
+
+    colors_.resize(points);
+    const SDL_Color* colors = terrain.colors();
+    for (int row = 0; row <= rows; row++) {
+        const SDL_Color* sourceRow = colors + (row0 + row) * sourceColumns + column0;
+        transform(sourceRow, sourceRow + columns + 1, colors_.begin() + latticeIndex(row, 0), packColor);
+    }
+}
+
+CompactTile::CompactTile(const Grid& grid, const vector<TileLayer>& layers)
+    : rows_(static_cast<int>(grid.rows())), columns_(static_cast<int>(grid.columns())),
+      cellSize_(grid.cellSize()),
+      triangleIndices_(Grid::rowMajorTriangleIndices(rows_, columns_)) {
+    setSystem(grid.system());
+
+    // The tile is always row-major, whatever the grid's lattice layout.
+    const size_t points = static_cast<size_t>(rows_ + 1) * (columns_ + 1);
+    vector<double> values(points);
+    auto gather = [&] (const double* source) {
+        for (int row = 0; row <= rows_; row++) {
+            for (int column = 0; column <= columns_; column++) {
+                values[latticeIndex(row, column)] = source[grid.latticeIndex(row, column)];
+            }
+        }
+    };
+    gather(grid.heights());
+    heights_.assign(values.data(), points);
+    for (TileLayer layer : layers) {
+        gather(layer == TileLayer::Slope ? grid.slopes() : grid.temperatures());
+        layers_[static_cast<int>(layer)].emplace().assign(values.data(), points);
+    }
+    colors_.resize(points);
+    for (int row = 0; row <= rows_; row++) {
+        for (int column = 0; column <= columns_; column++) {
+            colors_[latticeIndex(row, column)] = packColor(grid.colors()[grid.latticeIndex(row, column)]);
+        }
+    }
+}
+
+void CompactTile::setSystem(const Basis& system) {
+    system_ = system;
+    const Vector X = system.axisX;
+    const Vector Y = system.axisY;
+    const Vector Z = system.axisZ;
+    const Point& center = system.center;
+    modelMatrix_ = Matrix(X.x, Y.x, Z.x, center.x,
+                          X.y, Y.y, Z.y, center.y,
+                          X.z, Y.z, Z.z, center.z,
+                          0, 0, 0, 1);
+    const double xx = dotProduct(X, X), yy = dotProduct(Y, Y), zz = dotProduct(Z, Z);
+    const Matrix toLocal(X.x / xx, X.y / xx, X.z / xx, 0,
+                         Y.x / yy, Y.y / yy, Y.z / yy, 0,
+                         Z.x / zz, Z.y / zz, Z.z / zz, 0,
+                         0, 0, 0, 1);
+    worldToModel_ = toLocal * translationMatrix(-Vector(center));
+}
+
+int CompactTile::rows() const {
+    return rows_;
+}
+
+int CompactTile::columns() const {
+    return columns_;
+}
+
+double CompactTile::cellSize() const {
+    return cellSize_;
+}
+
+Basis CompactTile::system() const {
+    return system_;
+}
+
+size_t CompactTile::latticeIndex(int row, int column) const {
+    return static_cast<size_t>(columns_ + 1) * row + column;
+}
+
+double CompactTile::height(int row, int column) const {
+    return heights_[latticeIndex(row, column)];
+}
+
+SDL_Color CompactTile::color(int row, int column) const {
+    return unpackColor(colors_[latticeIndex(row, column)]);
+}
+
+Point CompactTile::position(int row, int column) const {
+    return Point((column - columns_ / 2.0) * cellSize_, height(row, column), (row - rows_ / 2.0) * cellSize_);
+}
+
+bool CompactTile::hasLayer(TileLayer layer) const {
+    return layers_[static_cast<int>(layer)].has_value();
+}
+
+double CompactTile::layer(TileLayer layer, int row, int column) const {
+    const optional<QuantizedLayer>& values = layers_[static_cast<int>(layer)];
+    if (!values) {
+        throw runtime_error(string("This tile doesn't keep the ") + layerName(layer) + " layer");
+    }
+    return (*values)[latticeIndex(row, column)];
+}
+
+void CompactTile::render(const Renderer& r) const {
+    const Renderer local = r.withModel(modelMatrix_, worldToModel_);
+    const Basis camera = local.getCamera();
+
+    // Skip the tile if its bounding sphere is entirely behind the camera.
+    const double low = heights_.offset;
+    const double high = heights_.offset + heights_.scale * 65535;
+    const Point center(0, (low + high) / 2, 0);
+    const double radius = Vector(columns_ * cellSize_ / 2, (high - low) / 2, rows_ * cellSize_ / 2).magnitude();
+    const double depth = dotProduct(center - camera.center, normalize(camera.axisZ));
+    if (depth < -radius) {
+        return;
+    }
+
+    // Double the stride until neighboring points are at least a pixel apart
+    // at the tile's nearest point.
+    const double spacing = cellSize_ * local.pixelsPerUnit(max(0.0, depth - radius));
+    int stride = 1;
+    while (stride * spacing < 1 && stride < max(rows_, columns_)) {
+        stride *= 2;
+    }
+    if (stride > 1 || local.getStyle() == RenderStyle::Points) {
+        const int endRow = (rows_ / stride + 1) * stride;
+        local.renderPoint(TilePointIterator(*this, stride, 0), TilePointIterator(*this, stride, endRow));
+        return;
+    }
+
+    // Nearer tiles are drawn as triangles, from their lattice rebuilt into
+    // scratch buffers that are reused from tile to tile.
+    static thread_local vector<Point> positions;
+    static thread_local vector<SDL_Color> colors;
+    const size_t points = colors_.size();
+    positions.resize(points);
+    colors.resize(points);
+    for (int row = 0; row <= rows_; row++) {
+        for (int column = 0; column <= columns_; column++) {
+            positions[latticeIndex(row, column)] = position(row, column);
+        }
+    }
+    transform(colors_.begin(), colors_.end(), colors.begin(), unpackColor);
+    if (local.getStyle() == RenderStyle::Wireframe) {
+        local.renderTriangles(positions.data(), colors.data(), *triangleIndices_);
+    } else {
+        local.renderFilledTriangles(positions.data(), colors.data(), *triangleIndices_);
+    }
+}
+
+Grid CompactTile::toGrid() const {
+    Grid grid(rows_, columns_, cellSize_);
+    const size_t points = grid.latticeSize();
+    vector<double> heights(points);
+    for (size_t i = 0; i < points; i++) {
+        heights[i] = heights_[i];
+    }
+    transform(colors_.begin(), colors_.end(), grid.colors(), unpackColor);
+    if (hasLayer(TileLayer::Temperature)) {
+        const QuantizedLayer& temperatures = *layers_[static_cast<int>(TileLayer::Temperature)];
+        for (size_t i = 0; i < points; i++) {
+            grid.temperatures()[i] = temperatures[i];
+        }
+    }
+
+    if (hasLayer(TileLayer::Slope)) {
+        // Keep the stored slopes rather than deriving them again.
+        const QuantizedLayer& slopes = *layers_[static_cast<int>(TileLayer::Slope)];
+        for (size_t i = 0; i < points; i++) {
+            grid.heights()[i] = heights[i];
+            grid.slopes()[i] = slopes[i];
+        }
+        grid.updateLattice();
+    } else {
+        grid.setHeights(0, 0, rows_ + 1, columns_ + 1, heights);
+    }
+    grid.apply(modelMatrix_);
+    return grid;
+}
+
+size_t CompactTile::bytes() const {
+    size_t count = 0;
+    for (const auto& values : layers_) {
+        count += values.has_value();
+    }
+    return bytes(rows_, columns_, count);
+}
+
+size_t CompactTile::bytes(int rows, int columns, size_t layerCount) {
+    const size_t points = static_cast<size_t>(rows + 1) * (columns + 1);
+    return sizeof(CompactTile) + points * (sizeof(uint16_t) * (1 + layerCount) + sizeof(uint32_t));
+}
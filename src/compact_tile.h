@@ -0,0 +1,116 @@
+#ifndef COMPACT_TILE_H_INCLUDED
+#define COMPACT_TILE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "SDL.h"
+#include "basis.h"
+#include "matrix.h"
+#include "point.h"
+
+class Grid;
+class Renderer;
+class TerrainFile;
+
+// One attribute of every lattice point, quantized to 16 bits.  Each value is
+// stored as round((value - offset) / scale), with the offset and scale picked
+// so that the layer's range spans all 65536 steps.  Values are off by at most
+// half a step: heights spanning 1000 m come back within 8 mm.
+struct QuantizedLayer {
+    std::vector<std::uint16_t> values;
+    double offset;
+    double scale;
+
+    QuantizedLayer();
+
+    // Quantizes count values.
+    void assign(const double* source, std::size_t count);
+
+    double operator[](std::size_t index) const {
+        return offset + scale * values[index];
+    }
+};
+
+// The attributes that a CompactTile can keep alongside its heights and
+// colors.  Aspect and roughness follow from the heights, so they're derived
+// again by toGrid() rather than stored.
+enum class TileLayer {
+    Slope,
+    Temperature
+};
+
+// A read-only tile of terrain that takes a fraction of the memory of a Grid.
+//
+// A Grid keeps every lattice point's position, several attributes as doubles
+// and the planes of its triangles, which comes to about 200 bytes a point.
+// A compact tile keeps only a 16-bit height and a packed 32-bit color, plus
+// 16 bits for each side layer that was asked for.  Positions are rebuilt from
+// the row, column and height whenever they are needed.
+class CompactTile {
+    public:
+        // Packs a rectangle of rows x columns cells of a terrain cache, whose
+        // upper left lattice point is (row0, column0).  The tile is placed
+        // where the rectangle sits within the terrain.
+        //
+        // Throws std::runtime_error if a layer isn't stored in the cache.
+        CompactTile(const TerrainFile& terrain, int row0, int column0, int rows, int columns,
+                    const std::vector<TileLayer>& layers = {});
+
+        // Packs a whole grid, keeping its placement.
+        explicit CompactTile(const Grid& grid, const std::vector<TileLayer>& layers = {});
+
+        int rows() const;
+        int columns() const;
+        double cellSize() const;
+        Basis system() const;
+
+        double height(int row, int column) const;
+        SDL_Color color(int row, int column) const;
+
+        // The lattice point in the tile's own coordinates, laid out like
+        // Grid::positions().
+        Point position(int row, int column) const;
+
+        bool hasLayer(TileLayer layer) const;
+
+        // Throws std::runtime_error if the tile doesn't keep the layer.
+        double layer(TileLayer layer, int row, int column) const;
+
+        // Draws the tile in the renderer's style, like Grid::render().  Far
+        // away tiles are drawn as points instead, skipping rows and columns
+        // so that points aren't drawn much closer than a pixel apart.
+        void render(const Renderer& r) const;
+
+        // Unpacks the tile into a full Grid, for editing or collisions.
+        Grid toGrid() const;
+
+        // The memory the tile uses, in bytes.
+        std::size_t bytes() const;
+
+        // The memory a tile of the given size would use.
+        static std::size_t bytes(int rows, int columns, std::size_t layerCount);
+
+    private:
+        int rows_, columns_;
+        double cellSize_;
+        Basis system_;
+        Matrix modelMatrix_;
+        Matrix worldToModel_;
+
+        QuantizedLayer heights_;
+        std::vector<std::uint32_t> colors_;     // RGBA, red in the low byte
+        std::optional<QuantizedLayer> layers_[2];
+
+        // Shared with every grid and tile of the same size, so it isn't
+        // counted by bytes().
+        std::shared_ptr<const std::vector<std::uint32_t>> triangleIndices_;
+
+        std::size_t latticeIndex(int row, int column) const;
+        void setSystem(const Basis& system);
+};
+
+#endif // COMPACT_TILE_H_INCLUDED
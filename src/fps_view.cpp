@@ -6,41 +6,28 @@
 using namespace std;
 
 FrameRateView::FrameRateView(const View& parentView_)
-    : parentView(parentView_), fpsTextSurface(nullptr) {}
-
-FrameRateView::~FrameRateView() {
-    if (fpsTextSurface != nullptr) {
-        SDL_FreeSurface(fpsTextSurface);
-    }
-}
+    : parentView(parentView_) {}
 
 void FrameRateView::updateFps(double averageFps) {
-    const AssetManager& am = getAssetManager();
-    TTF_Font* font = am.getFont("gidole");
     string text = to_string(averageFps);
-    text = text.substr(0, text.find(".") + 2);
-    if (fpsTextSurface != nullptr) {
-        SDL_FreeSurface(fpsTextSurface);
-    }
-    fpsTextSurface = TTF_RenderUTF8_Shaded(font, text.c_str(),
-                                           SDL_Color{255, 255, 255, 255}, SDL_Color{0, 0, 0, 0});
+    fpsText = text.substr(0, text.find(".") + 2);
 }
 
 void FrameRateView::draw(SDL_Surface* screen) {
     SDL_Rect textRect = boundary();
-    SDL_BlitSurface(fpsTextSurface,
-                    nullptr,
-                    screen,
-                    &textRect);
+    SDL_FillRect(screen, &textRect, SDL_MapRGB(screen->format, 0, 0, 0));
+    getAssetManager().getGlyphAtlas("gidole").draw(screen, fpsText, textRect.x, textRect.y,
+                                                   SDL_Color{255, 255, 255, 255});
 }
 
 // Define rectangle in bottom left of the parent view.
 SDL_Rect FrameRateView::boundary() const {
+    const GlyphAtlas& atlas = getAssetManager().getGlyphAtlas("gidole");
     SDL_Rect parentRect = parentView.boundary();
     SDL_Rect textRect {parentRect.x,
-                       parentRect.y + parentRect.h - fpsTextSurface->h,
-                       fpsTextSurface->w,
-                       fpsTextSurface->h};
+                       parentRect.y + parentRect.h - atlas.lineHeight(),
+                       atlas.textWidth(fpsText),
+                       atlas.lineHeight()};
     return textRect;
 }
 
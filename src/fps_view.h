@@ -1,6 +1,7 @@
 #ifndef FPS_VIEW_H_INCLUDED
 #define FPS_VIEW_H_INCLUDED
 
+#include <string>
 #include "view.h"
 
 class FrameRateView {
@@ -8,7 +9,6 @@ class FrameRateView {
         // Construct a frame rate view that will be
         // displayed in the corner of a parent view.
         FrameRateView(const View& parentView_);
-        ~FrameRateView();
 
         void draw(SDL_Surface* screen);
         SDL_Rect boundary() const;
@@ -18,8 +18,8 @@ class FrameRateView {
 
     private:
         const View& parentView;
-        // Stores a drawing of the last framerate that was passed into update fps 
-        SDL_Surface* fpsTextSurface;
+        // The last framerate that was passed into update fps, ready to draw
+        std::string fpsText;
 };
 
 
@@ -0,0 +1,98 @@
+#include "glyph_atlas.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    const int atlasWidth = 1024;
+}
+
+GlyphAtlas::GlyphAtlas(TTF_Font* font) : atlas(nullptr), lineHeight_(0) {
+    if (font == nullptr) {
+        throw runtime_error("Can't make a glyph atlas without a font");
+    }
+    lineHeight_ = TTF_FontHeight(font);
+
+    // Rasterize every glyph in white; draw() tints them with a color mod.
+    vector<SDL_Surface*> surfaces;
+    for (char c = firstCharacter; c <= lastCharacter; c++) {
+        SDL_Surface* surface = TTF_RenderGlyph_Blended(font, static_cast<Uint16>(c), SDL_Color{255, 255, 255, 255});
+        if (surface == nullptr) {
+            for (SDL_Surface* s : surfaces) {
+                SDL_FreeSurface(s);
+            }
+            throw runtime_error(TTF_GetError());
+        }
+        int minX, maxX, minY, maxY, advance;
+        if (TTF_GlyphMetrics(font, static_cast<Uint16>(c), &minX, &maxX, &minY, &maxY, &advance) != 0) {
+            advance = surface->w;
+        }
+        glyphs[c - firstCharacter].advance = advance;
+        surfaces.push_back(surface);
+    }
+
+    // Pack the glyphs into shelves of the atlas, left to right.
+    int x = 0, y = 0, shelfHeight = 0;
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        if (x + surfaces[i]->w > atlasWidth) {
+            x = 0;
+            y += shelfHeight;
+            shelfHeight = 0;
+        }
+        glyphs[i].rect = SDL_Rect{x, y, surfaces[i]->w, surfaces[i]->h};
+        x += surfaces[i]->w;
+        shelfHeight = max(shelfHeight, surfaces[i]->h);
+    }
+
+    atlas = SDL_CreateRGBSurfaceWithFormat(0, atlasWidth, y + shelfHeight, 32, SDL_PIXELFORMAT_RGBA32);
+    if (atlas == nullptr) {
+        for (SDL_Surface* s : surfaces) {
+            SDL_FreeSurface(s);
+        }
+        throw runtime_error(SDL_GetError());
+    }
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        // Copy the glyph's alpha as is instead of blending it onto the (empty) atlas.
+        SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(surfaces[i], nullptr, atlas, &glyphs[i].rect);
+        SDL_FreeSurface(surfaces[i]);
+    }
+    SDL_SetSurfaceBlendMode(atlas, SDL_BLENDMODE_BLEND);
+}
+
+GlyphAtlas::~GlyphAtlas() {
+    SDL_FreeSurface(atlas);
+}
+
+const GlyphAtlas::Glyph& GlyphAtlas::glyph(char c) const {
+    if (c < firstCharacter || c > lastCharacter) {
+        c = '?';
+    }
+    return glyphs[c - firstCharacter];
+}
+
+int GlyphAtlas::textWidth(const string& text) const {
+    int width = 0;
+    for (char c : text) {
+        width += glyph(c).advance;
+    }
+    return width;
+}
+
+int GlyphAtlas::lineHeight() const {
+    return lineHeight_;
+}
+
+void GlyphAtlas::draw(SDL_Surface* screen, const string& text, int x, int y, SDL_Color color) const {
+    SDL_SetSurfaceColorMod(atlas, color.r, color.g, color.b);
+    for (char c : text) {
+        const Glyph& g = glyph(c);
+        SDL_Rect source = g.rect;
+        SDL_Rect destination = SDL_Rect{x, y, 0 /* ignored */, 0 /* ignored */};
+        SDL_BlitSurface(atlas, &source, screen, &destination);
+        x += g.advance;
+    }
+}
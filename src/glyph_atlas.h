@@ -0,0 +1,46 @@
+#ifndef GLYPH_ATLAS_H_INCLUDED
+#define GLYPH_ATLAS_H_INCLUDED
+
+#include <string>
+#include "SDL.h"
+#include "SDL_ttf.h"
+
+// Every printable ASCII character of one font, rasterized once into a single
+// surface.  Drawing text is then just a blit per character, which is cheap
+// enough to redo every frame, unlike TTF_RenderUTF8_*().
+//
+// Get these from AssetManager::getGlyphAtlas() rather than making your own.
+class GlyphAtlas {
+    public:
+        // Throws std::runtime_error if the font can't be rasterized.
+        explicit GlyphAtlas(TTF_Font* font);
+        ~GlyphAtlas();
+
+        GlyphAtlas(const GlyphAtlas&) = delete;
+        GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+        // The width and height, in pixels, that draw() would cover.
+        int textWidth(const std::string& text) const;
+        int lineHeight() const;
+
+        // Draws the text with its top left corner at (x, y).  Characters
+        // outside printable ASCII are drawn as '?'.
+        void draw(SDL_Surface* screen, const std::string& text, int x, int y, SDL_Color color) const;
+
+    private:
+        static const char firstCharacter = ' ';
+        static const char lastCharacter = '~';
+
+        struct Glyph {
+            SDL_Rect rect;  // Where the glyph is in the atlas
+            int advance;    // How far to move right after drawing it
+        };
+
+        SDL_Surface* atlas;
+        Glyph glyphs[lastCharacter - firstCharacter + 1];
+        int lineHeight_;
+
+        const Glyph& glyph(char c) const;
+};
+
+#endif // GLYPH_ATLAS_H_INCLUDED
@@ -1,66 +1,427 @@
 #include "grid.h"
 #include "plane.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "common.h"
 #include "matrix.h"
 #include "render.h"
+#include "terrain_file.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+
+namespace {
+    // The most triangles that the level of detail may select in one frame.
+    const std::size_t lodTriangleBudget = 200000;
+
+    // Returns the triangle indices for a lattice of the given size and
+    // layout, whose points are numbered by latticeIndex(row, column),
+    // building them only if no other such lattice is using them.  Pager
+    // tiles are mostly the same size, so they all share one buffer.
+    template <typename LatticeIndex>
+    std::shared_ptr<const std::vector<uint32_t>> sharedTriangleIndices(int rows, int columns, LatticeLayout layout,
+                                                                       LatticeIndex latticeIndex) {
+        static std::mutex mutex;
+        static std::map<std::tuple<int, int, LatticeLayout>, std::weak_ptr<const std::vector<uint32_t>>> cache;
+
+        std::lock_guard<std::mutex> guard(mutex);
+        std::weak_ptr<const std::vector<uint32_t>>& cached = cache[std::make_tuple(rows, columns, layout)];
+        if (auto indices = cached.lock()) {
+            return indices;
+        }
 
+        auto indices = std::make_shared<std::vector<uint32_t>>();
+        indices->reserve(6 * static_cast<size_t>(rows) * columns);
+        for (int row = 0; row <= rows - 1; row++) {
+            for (int column = 0; column <= columns - 1; column++) {
+                uint32_t ul_index = latticeIndex(row, column);
+                uint32_t ur_index = latticeIndex(row, column + 1);
+                uint32_t ll_index = latticeIndex(row + 1, column);
+                uint32_t lr_index = latticeIndex(row + 1, column + 1);
+                indices->insert(indices->end(), {ul_index, ur_index, ll_index, lr_index, ur_index, ll_index});
+            }
+        }
+        cached = indices;
+        return indices;
+    }
 
-GridPoint::GridPoint() : Point(0, 0, 0), color(SDL_Color{255, 255, 255, 255}), temperatureKelvin(0), slopeDeg(0), height(0) {}
-GridPoint::GridPoint(Point p, SDL_Color color_, double temperatureKelvin_, double slopeDeg_, double height_)
-    : Point(p), color(color_), temperatureKelvin(temperatureKelvin_), slopeDeg(slopeDeg_), height(height_) {}
+    std::shared_ptr<const std::vector<uint32_t>> sharedTriangleIndices(const Grid& grid) {
+        return sharedTriangleIndices(static_cast<int>(grid.rows()), static_cast<int>(grid.columns()),
+                                     grid.latticeLayout(), [&grid] (int row, int column) {
+                                         return grid.latticeIndex(row, column);
+                                     });
+    }
 
-Grid::Grid() : lattice((49 + 1) * (49 + 1)),
-               system_(),
+    // What IndexedPointIterator points at: a lattice point's position and
+    // color, gathered from the grid's separate arrays.
+    struct ColorPoint {
+        const Point& position;
+        SDL_Color color;
+        operator Point() const { return position; }
+    };
+
+    // Walks the lattice points named by a list of indices, so that the
+    // renderer can draw an arbitrary subset of the lattice.
+    class IndexedPointIterator {
+        public:
+            IndexedPointIterator(const Point* positions, const SDL_Color* colors,
+                                 std::vector<uint32_t>::const_iterator position)
+                : positions_(positions), colors_(colors), position_(position) {}
+
+            // operator->() has to return something that itself has an
+            // operator->(), since there is no ColorPoint in memory to point at.
+            struct Arrow {
+                ColorPoint point;
+                const ColorPoint* operator->() const { return &point; }
+            };
+
+            ColorPoint operator*() const { return ColorPoint{positions_[*position_], colors_[*position_]}; }
+            Arrow operator->() const { return Arrow{**this}; }
+            IndexedPointIterator& operator++() { ++position_; return *this; }
+            bool operator!=(const IndexedPointIterator& other) const { return position_ != other.position_; }
+        private:
+            const Point* positions_;
+            const SDL_Color* colors_;
+            std::vector<uint32_t>::const_iterator position_;
+    };
+
+    // The placement of an overview of terrain.  An overview drops the last
+    // rows % stride rows and columns % stride columns, so its center is moved
+    // to keep every sample where it sits within the full terrain.
+    Basis overviewSystem(const TerrainFile& terrain, int stride) {
+        const Basis system = terrain.system();
+        const int rows = terrain.rows() / stride * stride;
+        const int columns = terrain.columns() / stride * stride;
+        return Basis(system.center +
+                     (columns - terrain.columns()) / 2.0 * terrain.cellSize() * system.axisX +
+                     (rows - terrain.rows()) / 2.0 * terrain.cellSize() * system.axisZ,
+                     system.axisX, system.axisY, system.axisZ);
+    }
+}
+
+GridPoint::GridPoint() : Point(0, 0, 0), color(SDL_Color{255, 255, 255, 255}), temperatureKelvin(0), slopeDeg(0), height(0),
+                         aspectDeg(0), roughness(0) {}
+GridPoint::GridPoint(Point p, SDL_Color color_, double temperatureKelvin_, double slopeDeg_, double height_,
+                     double aspectDeg_, double roughness_)
+    : Point(p), color(color_), temperatureKelvin(temperatureKelvin_), slopeDeg(slopeDeg_), height(height_),
+      aspectDeg(aspectDeg_), roughness(roughness_) {}
+
+Grid::Grid() : system_(),
                rows_(49),
                columns_(49),
-               cellSize_(1) {
+               cellSize_(1),
+               layout_(LatticeLayout::RowMajor) {
+                   setGridTransform();
+                   allocateLattice();
                    setLatticePoints();
 }
 
 Grid::Grid(int rows_, int columns_, double cellSize_)
-    : lattice((rows_ + 1) * (columns_ + 1)),
-      system_(),
+    : system_(),
       rows_(rows_),
       columns_(columns_),
-      cellSize_(cellSize_) {
+      cellSize_(cellSize_),
+      layout_(LatticeLayout::RowMajor) {
+    setGridTransform();
+    allocateLattice();
+    setLatticePoints();
+}
+
+Grid::Grid(const TerrainFile& terrain, int stride)
+    : system_(overviewSystem(terrain, stride)),
+      rows_(terrain.rows() / stride),
+      columns_(terrain.columns() / stride),
+      cellSize_(terrain.cellSize() * stride),
+      layout_(LatticeLayout::RowMajor) {
+    setGridTransform();
+    const float* heights = terrain.heights();
+    const float* slopes = terrain.slopes();
+    const SDL_Color* colors = terrain.colors();
+    const size_t sourceColumns = terrain.columns() + 1;
+    allocateLattice();
+    for (int row = 0; row <= rows_; row++) {
+        const size_t sourceRowStart = static_cast<size_t>(row) * stride * sourceColumns;
+        for (int column = 0; column <= columns_; column++) {
+            const size_t source = sourceRowStart + static_cast<size_t>(column) * stride;
+            const size_t index = latticeIndex(row, column);
+            heights_[index] = heights[source];
+            slopes_[index] = slopes[source];
+            colors_[index] = colors[source];
+        }
+    }
+    deriveSurface(GridRegion(0, 0, rows_, columns_), false);
     setLatticePoints();
 }
 
+GridRegion::GridRegion() : row0(0), column0(0), row1(-1), column1(-1) {}
+
+GridRegion::GridRegion(int row0_, int column0_, int row1_, int column1_)
+    : row0(row0_), column0(column0_), row1(row1_), column1(column1_) {}
+
+bool GridRegion::empty() const {
+    return row1 < row0 || column1 < column0;
+}
+
+void GridRegion::include(int row, int column) {
+    if (empty()) {
+        *this = GridRegion(row, column, row, column);
+        return;
+    }
+    row0 = std::min(row0, row);
+    column0 = std::min(column0, column);
+    row1 = std::max(row1, row);
+    column1 = std::max(column1, column);
+}
+
+Point Grid::latticePosition(double row, double column, double height) const {
+    // Row 0 and column 0 are half the grid away from the center.
+    return Point((column - columns_ / 2.0) * cellSize_, height, (row - rows_ / 2.0) * cellSize_);
+}
+
+void Grid::setGridTransform() {
+    const Vector X = system_.axisX;
+    const Vector Y = system_.axisY;
+    const Vector Z = system_.axisZ;
+    const Point& center = system_.center;
+    gridNormal_ = normalize(Y);
+
+    modelMatrix_ = Matrix(X.x, Y.x, Z.x, center.x,
+                          X.y, Y.y, Z.y, center.y,
+                          X.z, Y.z, Z.z, center.z,
+                          0, 0, 0, 1);
+
+    // For orthogonal axes, dotting with X / |X|^2 undoes a multiple of X.
+    const double xx = dotProduct(X, X), yy = dotProduct(Y, Y), zz = dotProduct(Z, Z);
+    const Matrix toLocal(X.x / xx, X.y / xx, X.z / xx, 0,
+                         Y.x / yy, Y.y / yy, Y.z / yy, 0,
+                         Z.x / zz, Z.y / zz, Z.z / zz, 0,
+                         0, 0, 0, 1);
+    worldToLocal_ = toLocal * translationMatrix(-Vector(center));
+
+    // Normals go through the inverse transpose, so that they stay
+    // perpendicular to the surface when the axes are scaled unevenly.
+    normalToWorld_ = Matrix(X.x / xx, Y.x / yy, Z.x / zz, 0,
+                            X.y / xx, Y.y / yy, Z.y / zz, 0,
+                            X.z / xx, Y.z / yy, Z.z / zz, 0,
+                            0, 0, 0, 1);
+
+    // For orthogonal axes, dotting with X / |X|^2 undoes a multiple of X.
+    // Dividing by the grid's size as well takes columns straight to v and
+    // rows straight to u, and the 0.5 moves (0, 0) to the upper left.
+    const double vScale = 1.0 / (dotProduct(X, X) * cellSize_ * std::max(columns_, 1));
+    const double uScale = 1.0 / (dotProduct(Z, Z) * cellSize_ * std::max(rows_, 1));
+    const Matrix toGrid(X.x * vScale, X.y * vScale, X.z * vScale, 0.5,
+                        gridNormal_.x, gridNormal_.y, gridNormal_.z, 0,
+                        Z.x * uScale, Z.y * uScale, Z.z * uScale, 0.5,
+                        0, 0, 0, 1);
+    worldToGrid_ = toGrid * translationMatrix(-Vector(system_.center));
+
+    const double columnScale = 1.0 / (dotProduct(X, X) * cellSize_);
+    const double heightScale = 1.0 / dotProduct(Y, Y);
+    const double rowScale = 1.0 / (dotProduct(Z, Z) * cellSize_);
+    const Matrix toLattice(X.x * columnScale, X.y * columnScale, X.z * columnScale, columns_ / 2.0,
+                           Y.x * heightScale, Y.y * heightScale, Y.z * heightScale, 0,
+                           Z.x * rowScale, Z.y * rowScale, Z.z * rowScale, rows_ / 2.0,
+                           0, 0, 0, 1);
+    worldToLattice_ = toLattice * translationMatrix(-Vector(system_.center));
+}
+
+void Grid::allocateLattice() {
+    tileColumns_ = (columns_ + latticeTileSize) / latticeTileSize;
+    const size_t points = latticeSize();
+    positions_.assign(points, Point(0, 0, 0));
+    heights_.assign(points, 0);
+    slopes_.assign(points, 0);
+    temperatures_.assign(points, 0);
+    aspects_.assign(points, 0);
+    roughness_.assign(points, 0);
+    colors_.assign(points, SDL_Color{255, 255, 255, 255});
+    triangleIndices_ = sharedTriangleIndices(*this);
+    const size_t triangles = 2 * static_cast<size_t>(rows_) * columns_;
+    trianglePlanes_.assign(triangles, Plane());
+    triangleNormals_.assign(triangles, Vector(0, 1, 0));
+}
+
+void Grid::setTrianglePlanes(int cellRow0, int cellColumn0, int cellRow1, int cellColumn1) {
+    for (int row = cellRow0; row <= cellRow1; row++) {
+        for (int column = cellColumn0; column <= cellColumn1; column++) {
+            const Point& ul = positions_[latticeIndex(row, column)];
+            const Point& ur = positions_[latticeIndex(row, column + 1)];
+            const Point& ll = positions_[latticeIndex(row + 1, column)];
+            const Point& lr = positions_[latticeIndex(row + 1, column + 1)];
+            const size_t first = 2 * (static_cast<size_t>(row) * columns_ + column);
+            const Plane planes[2] = {Plane(ul, ur, ll), Plane(lr, ur, ll)};
+            for (size_t i = 0; i < 2; i++) {
+                Plane plane = planes[i];
+                // Point the planes up the lattice's height axis.
+                if (plane.B < 0) {
+                    plane = Plane(-plane.A, -plane.B, -plane.C, -plane.D);
+                }
+                trianglePlanes_[first + i] = plane;
+                triangleNormals_[first + i] = normalize(plane.normalVector());
+            }
+        }
+    }
+}
+
+void Grid::deriveSurface(const GridRegion& region, bool deriveSlopes) {
+    if (region.empty()) {
+        return;
+    }
+
+    // A height change moves the stencil of every neighbor as well.
+    const int row0 = std::max(region.row0 - 1, 0);
+    const int row1 = std::min(region.row1 + 1, rows_);
+    const int column0 = std::max(region.column0 - 1, 0);
+    const int column1 = std::min(region.column1 + 1, columns_);
+
+    getThreadPool().parallelFor(row0, row1 + 1, [&] (int firstRow, int lastRow) {
+        const int width = column1 - column0 + 1;
+        std::vector<double> alongColumns(width), alongRows(width), range(width);
+
+        // The stencil reads whole rows of heights.  A tiled lattice doesn't
+        // store its rows contiguously, so they are gathered first.
+        std::vector<double> gathered[3];
+        auto heightRow = [&] (int row, int slot) -> const double* {
+            if (layout_ == LatticeLayout::RowMajor) {
+                return &heights_[latticeIndex(row, 0)];
+            }
+            gathered[slot].resize(columns_ + 1);
+            for (int column = column0; column <= column1; column++) {
+                gathered[slot][column] = heights_[latticeIndex(row, column)];
+            }
+            if (column0 > 0) {
+                gathered[slot][column0 - 1] = heights_[latticeIndex(row, column0 - 1)];
+            }
+            if (column1 < columns_) {
+                gathered[slot][column1 + 1] = heights_[latticeIndex(row, column1 + 1)];
+            }
+            return gathered[slot].data();
+        };
+
+        for (int row = firstRow; row < lastRow; row++) {
+            // Points on the edges of the grid reuse their own heights in
+            // place of the missing neighbors, and the differences are taken
+            // over one cell instead of two.
+            const int rowAbove = std::max(row - 1, 0);
+            const int rowBelow = std::min(row + 1, rows_);
+            const double* above = heightRow(rowAbove, 0);
+            const double* here = heightRow(row, 1);
+            const double* below = heightRow(rowBelow, 2);
+            const double rowRun = 4 * cellSize_ * std::max(rowBelow - rowAbove, 1);
+
+            auto stencil = [&] (int i, int left, int column, int right) {
+                alongColumns[i] = ((above[right] + 2 * here[right] + below[right]) -
+                                   (above[left] + 2 * here[left] + below[left])) / (4 * cellSize_ * std::max(right - left, 1));
+                alongRows[i] = ((below[left] + 2 * below[column] + below[right]) -
+                                (above[left] + 2 * above[column] + above[right])) / rowRun;
+                const double low = std::min({above[left], above[column], above[right],
+                                             here[left], here[column], here[right],
+                                             below[left], below[column], below[right]});
+                const double high = std::max({above[left], above[column], above[right],
+                                              here[left], here[column], here[right],
+                                              below[left], below[column], below[right]});
+                range[i] = high - low;
+            };
+
+            // Away from the left and right edges this is plain arithmetic on
+            // neighboring columns, which the compiler can vectorize.
+            const int first = std::max(column0, 1);
+            const int last = std::min(column1, columns_ - 1);
+            if (column0 == 0) {
+                stencil(0, 0, 0, std::min(1, columns_));
+            }
+            for (int column = first; column <= last; column++) {
+                stencil(column - column0, column - 1, column, column + 1);
+            }
+            if (column1 == columns_ && columns_ > 0) {
+                stencil(width - 1, columns_ - 1, columns_, columns_);
+            }
+
+            // Aspect is measured clockwise from the direction of row 0, like a
+            // compass bearing on the nav map, and points downhill.
+            for (int i = 0; i < width; i++) {
+                const size_t index = latticeIndex(row, column0 + i);
+                const double gradient = std::sqrt(alongColumns[i] * alongColumns[i] + alongRows[i] * alongRows[i]);
+                if (deriveSlopes) {
+                    slopes_[index] = std::atan(gradient) * rad_to_deg;
+                }
+                double aspect = std::atan2(-alongColumns[i], alongRows[i]) * rad_to_deg;
+                aspects_[index] = aspect < 0 ? aspect + 360 : aspect;
+                roughness_[index] = range[i];
+            }
+        }
+    });
+}
+
 void Grid::setLatticePoints() {
-    Point displacedCenter = system_.center;
-    displacedCenter.x = system_.center.x - (columns_ / 2.0 * cellSize_);
-    displacedCenter.z = system_.center.z - (rows_ / 2.0 * cellSize_);
+    getThreadPool().parallelFor(0, rows_ + 1, [this] (int firstRow, int lastRow) {
+        for (int row = firstRow; row < lastRow; row += 1) {
+            for (int column = 0; column <= columns_; column += 1) {
+                size_t index = latticeIndex(row, column);
+                positions_[index] = latticePosition(row, column, heights_[index]);
+            }
+        }
+    });
+    getThreadPool().parallelFor(0, rows_, [this] (int firstRow, int lastRow) {
+        setTrianglePlanes(firstRow, 0, lastRow - 1, columns_ - 1);
+    });
+    lod.build(*this);
+    heightPyramid.build(*this);
+}
 
-    for (int row = 0; row <= rows_; row += 1) {
-        for (int column = 0; column <= columns_; column += 1) {
-            int index = (columns_ + 1) * row + column;
-            GridPoint& gridPoint = lattice[index];
-            Point actualLocation = displacedCenter + (column * cellSize_ * system_.axisX) + (row * cellSize_ * system_.axisZ) + (gridPoint.height * system_.axisY);
-            gridPoint.x = actualLocation.x;
-            gridPoint.y = actualLocation.y;
-            gridPoint.z = actualLocation.z;
+void Grid::setLatticePoints(const GridRegion& region) {
+    if (region.empty()) {
+        return;
+    }
+    for (int row = region.row0; row <= region.row1; row++) {
+        for (int column = region.column0; column <= region.column1; column++) {
+            const size_t index = latticeIndex(row, column);
+            positions_[index] = latticePosition(row, column, heights_[index]);
         }
     }
-    triangles = facetize();
+
+    // The triangle indices only refer to the lattice by index, so they stay
+    // valid, but the planes of every cell touching the region have moved.
+    setTrianglePlanes(std::max(region.row0 - 1, 0), std::max(region.column0 - 1, 0),
+                      std::min(region.row1, rows_ - 1), std::min(region.column1, columns_ - 1));
+    lod.update(*this, region);
+    heightPyramid.update(*this, region);
 }
 
 void Grid::setHeightByFunction(std::function<double(double,double)> zCoordinateFunc,
                                std::function<SDL_Color(double, double)> colorFunc) {
-    // zCoordinateFunc takes normalized coordinates
-    int index = 0;
-    for (double y = 0; y <= 1; y += 1.0/(rows_)) {
-        for (double x = 0; x <= 1; x += 1.0/(columns_)) {
-            double z = zCoordinateFunc(x, y);
-            SDL_Color a = colorFunc(x, y);
-            GridPoint& gridPoint = lattice.at(index);
-            gridPoint.height = z;
-            gridPoint.color = a;
-            index++;
+    // zCoordinateFunc takes normalized coordinates.  Stepping by integers
+    // (rather than adding 1.0/rows_ up to 1) hits every row exactly once.
+    for (int row = 0; row <= rows_; row++) {
+        const double y = normalizedRow(row);
+        for (int column = 0; column <= columns_; column++) {
+            const double x = normalizedColumn(column);
+            const size_t index = latticeIndex(row, column);
+            heights_[index] = zCoordinateFunc(x, y);
+            colors_[index] = colorFunc(x, y);
         }
     }
+    deriveSurface(GridRegion(0, 0, rows_, columns_), true);
     setLatticePoints();
 }
 
+double Grid::normalizedRow(int row) const {
+    return rows_ > 0 ? double(row) / rows_ : 0;
+}
+
+double Grid::normalizedColumn(int column) const {
+    return columns_ > 0 ? double(column) / columns_ : 0;
+}
+
 Basis Grid::system() const {
     return system_;
 }
@@ -78,7 +439,7 @@ double Grid::cellSize() const {
 }
 
 Plane Grid::gridPlane() const {
-    return Plane(system_.center, system_.axisY);
+    return Plane(system_.center, gridNormal_);
 }
 
 Plane Grid::leftPlane() const {
@@ -106,129 +467,367 @@ Plane Grid::backPlane() const {
 }
 
 void Grid::render(const Renderer& r) const {
-    r.renderPoint(lattice.begin(), lattice.end());
-
-    // r.renderPolygon(triangles.begin(), triangles.end());
+    // The lattice stays in the grid's own coordinates; the model matrix is
+    // folded into the camera instead.
+    const Renderer local = r.withModel(modelMatrix_, worldToLocal_);
+    lod.select(*this, local, lodTriangleBudget);
+    switch (r.getStyle()) {
+        case RenderStyle::Filled:
+            local.renderFilledTriangles(positions_.data(), colors_.data(), lod.indices());
+            break;
+        case RenderStyle::Wireframe:
+            local.renderTriangles(positions_.data(), colors_.data(), lod.indices());
+            break;
+        case RenderStyle::Points: {
+            const std::vector<uint32_t>& vertices = lod.vertices();
+            local.renderPoint(IndexedPointIterator(positions_.data(), colors_.data(), vertices.begin()),
+                              IndexedPointIterator(positions_.data(), colors_.data(), vertices.end()));
+            break;
+        }
+    }
 }
 
 std::tuple<double, double, double> Grid::gridLocation(Point p) const {
-    Plane P = gridPlane();
-    // Guarantees that the ray will hit the grid, no matter how far you are from it;
-    double rayDistance = (distance(system_.center, p) * 2);
-    Point pointPastPlane = p + -P.whichSide(p) * P.normalVector() * rayDistance;
-    auto op = P.pointOfIntersection(p, pointPastPlane);
-    if (!op) {
-        throw std::runtime_error("Internal error: line segment didn't hit plane.");
-    } else {
-        // std::cout << "Point where gridplane is intersected: " << *op << "\n";
+    const Point local = worldToGrid_ * p;
+    return std::make_tuple(local.z, local.x, std::abs(local.y));
+}
+
+std::vector<std::tuple<double, double, double>> Grid::gridLocation(const std::vector<Point>& points) const {
+    std::vector<std::tuple<double, double, double>> locations;
+    locations.reserve(points.size());
+    for (const Point& p : points) {
+        const Point local = worldToGrid_ * p;
+        locations.emplace_back(local.z, local.x, std::abs(local.y));
     }
+    return locations;
+}
 
-    // Calculate the height of p from the gridPlane (P).
-    double h = distance(p, *op);
+Point Grid::findFloor(double u, double v) const {
+    u = std::clamp(u, 0.0, 1.0);
+    v = std::clamp(v, 0.0, 1.0);
+    return modelMatrix_ * latticePosition(u * rows_, v * columns_, floorHeight(u, v));
+}
 
-    // Use the cameraTransform function to transform the grid's basis to i, j, k origin.
-    // This will give us a matrix that will transform p into a new point, p'.
-    // p' will be used for the parameters of interpolation.
-    Point pPrime = cameraTransform(system_.axisX, system_.axisY, system_.axisZ, system_.center) * p;
-    // std::cout << "pPrime: " << pPrime << "\n";
+size_t Grid::triangleAt(double u, double v) const {
+    const double row = std::clamp(u, 0.0, 1.0) * rows_;
+    const double column = std::clamp(v, 0.0, 1.0) * columns_;
+    const int cellRow = std::min(static_cast<int>(row), rows_ - 1);
+    const int cellColumn = std::min(static_cast<int>(column), columns_ - 1);
+    const size_t first = 2 * (static_cast<size_t>(cellRow) * columns_ + cellColumn);
 
-    double v = pPrime.x / (cellSize_ * (columns_ + 1));
-    double u = pPrime.z / (cellSize_ * (rows_ + 1));
-    return std::make_tuple(u + 0.5, v + 0.5, h);
+    // The diagonal runs from the upper right to the lower left corner, so
+    // the first triangle (ul, ur, ll) is the half nearer the upper left.
+    return (row - cellRow) + (column - cellColumn) <= 1 ? first : first + 1;
+}
 
+double Grid::floorHeight(double u, double v) const {
+    u = std::clamp(u, 0.0, 1.0);
+    v = std::clamp(v, 0.0, 1.0);
+    const Plane& plane = trianglePlanes_[triangleAt(u, v)];
+
+    // Slide the point straight up from the grid plane until it meets the
+    // triangle's plane: whichSide(base + (0, h, 0)) = 0.
+    const Point base = latticePosition(u * rows_, v * columns_, 0);
+    return -plane.whichSide(base) / plane.B;
 }
 
-Point Grid::findFloor(double u, double v) const {
-    if (u < 0) {
-        u = 0;
+Vector Grid::floorNormal(double u, double v) const {
+    return normalize(normalToWorld_ * triangleNormals_[triangleAt(u, v)]);
+}
+
+void Grid::floorHeights(const double* u, const double* v, size_t count,
+                        double* heights, Vector* normals) const {
+    size_t i = 0;
+
+#ifdef __AVX2__
+    // The same arithmetic as triangleAt() and floorHeight(), four samples
+    // at a time.  The planes are gathered with 32-bit indices, so enormous
+    // grids fall through to the scalar loop.
+    static_assert(sizeof(Plane) == 4 * sizeof(double), "Plane must be exactly A, B, C and D");
+    if (rows_ > 0 && columns_ > 0 && trianglePlanes_.size() <= 0x7fffffff / 4) {
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d rows = _mm256_set1_pd(rows_);
+        const __m256d columns = _mm256_set1_pd(columns_);
+        const __m256d lastCellRow = _mm256_set1_pd(rows_ - 1);
+        const __m256d lastCellColumn = _mm256_set1_pd(columns_ - 1);
+
+        // (origin.x + column * cellSize, 0, origin.z + row * cellSize) is
+        // the point on the grid plane under (u, v).
+        const Point origin = latticePosition(0, 0, 0);
+        const __m256d originX = _mm256_set1_pd(origin.x);
+        const __m256d originZ = _mm256_set1_pd(origin.z);
+        const __m256d cellSize = _mm256_set1_pd(cellSize_);
+        const double* planes = &trianglePlanes_.data()->A;
+
+        alignas(16) int32_t triangles[4];
+        for (; i + 4 <= count; i += 4) {
+            const __m256d uu = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(u + i), zero), one);
+            const __m256d vv = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(v + i), zero), one);
+            const __m256d row = _mm256_mul_pd(uu, rows);
+            const __m256d column = _mm256_mul_pd(vv, columns);
+            const __m256d cellRow = _mm256_min_pd(_mm256_floor_pd(row), lastCellRow);
+            const __m256d cellColumn = _mm256_min_pd(_mm256_floor_pd(column), lastCellColumn);
+            const __m256d across = _mm256_add_pd(_mm256_sub_pd(row, cellRow), _mm256_sub_pd(column, cellColumn));
+            const __m256d second = _mm256_and_pd(_mm256_cmp_pd(across, one, _CMP_GT_OQ), one);
+            const __m256d cell = _mm256_add_pd(_mm256_mul_pd(cellRow, columns), cellColumn);
+            const __m256d triangle = _mm256_add_pd(_mm256_add_pd(cell, cell), second);
+            const __m128i triangleIndex = _mm256_cvttpd_epi32(triangle);
+            const __m128i planeIndex = _mm_slli_epi32(triangleIndex, 2);
+
+            const __m256d A = _mm256_i32gather_pd(planes, planeIndex, 8);
+            const __m256d B = _mm256_i32gather_pd(planes + 1, planeIndex, 8);
+            const __m256d C = _mm256_i32gather_pd(planes + 2, planeIndex, 8);
+            const __m256d D = _mm256_i32gather_pd(planes + 3, planeIndex, 8);
+
+            const __m256d baseX = _mm256_add_pd(originX, _mm256_mul_pd(column, cellSize));
+            const __m256d baseZ = _mm256_add_pd(originZ, _mm256_mul_pd(row, cellSize));
+            const __m256d side = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(A, baseX), _mm256_mul_pd(C, baseZ)), D);
+            _mm256_storeu_pd(heights + i, _mm256_div_pd(_mm256_sub_pd(zero, side), B));
+
+            if (normals) {
+                _mm_store_si128(reinterpret_cast<__m128i*>(triangles), triangleIndex);
+                for (int lane = 0; lane < 4; lane++) {
+                    normals[i + lane] = normalize(normalToWorld_ * triangleNormals_[triangles[lane]]);
+                }
+            }
+        }
     }
-    if (v < 0) {
-        v = 0;
+#endif
+
+    for (; i < count; i++) {
+        heights[i] = floorHeight(u[i], v[i]);
+        if (normals) {
+            normals[i] = floorNormal(u[i], v[i]);
+        }
     }
+}
 
-    if (u > 1) {
-        u = 1;
+std::optional<RayHit> Grid::castRay(Point origin, Vector direction, double maxDistance) const {
+    const double length = direction.magnitude();
+    if (length == 0) {
+        return std::nullopt;
     }
-    if (v > 1) {
-        v = 1;
+
+    // The transformation to lattice space is affine, so t means the same
+    // point along the ray in both spaces.
+    const auto hit = heightPyramid.castRay(*this, worldToLattice_ * origin, worldToLattice_ * direction,
+                                           maxDistance / length);
+    if (!hit) {
+        return std::nullopt;
     }
+    const auto [t, row, column] = *hit;
+    return RayHit{origin + t * direction, row, column, t * length};
+}
 
-    double row = u * (rows_);
-    double column = v * (columns_);
+std::vector<std::optional<RayHit>> Grid::castRays(const std::vector<Ray>& rays, double maxDistance) const {
+    std::vector<std::optional<RayHit>> hits(rays.size());
+    getThreadPool().parallelFor(0, static_cast<int>(rays.size()), [&] (int first, int last) {
+        for (int i = first; i < last; i++) {
+            hits[i] = castRay(rays[i].origin, rays[i].direction, maxDistance);
+        }
+    });
+    return hits;
+}
 
-    auto index = [this] (int column, int row) {
-        return (this->columns_ + 1) * row + column;
+void Grid::apply(const Matrix& transformationMatrix) {
+    // Only the basis moves; the lattice stays in the grid's own coordinates.
+    system_.apply(transformationMatrix);
+    setGridTransform();
+}
+
+std::vector<Polygon> Grid::facetize() const {
+    std::vector<Polygon> bag;
+    const std::vector<uint32_t>& indices = *triangleIndices_;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        Polygon triangle = Polygon(positions_, {a, b, c});
+        for (Vertex& vertex : triangle.vertices) {
+            (Point&)vertex = modelMatrix_ * vertex;
+        }
+        bag.push_back(triangle);
+    }
+    return bag;
+}
+
+void Grid::setHeight(int row, int column, double newHeight) {
+    setHeights({HeightEdit{row, column, newHeight}});
+}
+
+double Grid::getHeight(int row, int column) const {
+    if (row < 0 || row > rows_ || column < 0 || column > columns_) {
+        throw std::runtime_error("(" + std::to_string(row) + ", " + std::to_string(column) + ") is outside the grid");
+    }
+    return heights_[latticeIndex(row, column)];
+}
+
+GridRegion Grid::setHeights(const std::vector<HeightEdit>& edits) {
+    GridRegion dirty;
+    for (const HeightEdit& edit : edits) {
+        if (edit.row < 0 || edit.row > rows_ || edit.column < 0 || edit.column > columns_) {
+            throw std::runtime_error("Height edit at (" + std::to_string(edit.row) + ", " +
+                                     std::to_string(edit.column) + ") is outside the grid");
+        }
+    }
+    for (const HeightEdit& edit : edits) {
+        heights_[latticeIndex(edit.row, edit.column)] = edit.height;
+        dirty.include(edit.row, edit.column);
+    }
+    deriveSurface(dirty, true);
+    setLatticePoints(dirty);
+    return dirty;
+}
+
+GridRegion Grid::setHeights(int row0, int column0, int patchRows, int patchColumns,
+                            const std::vector<double>& heights) {
+    if (patchRows <= 0 || patchColumns <= 0) {
+        return GridRegion();
+    }
+    if (row0 < 0 || column0 < 0 || row0 + patchRows - 1 > rows_ || column0 + patchColumns - 1 > columns_) {
+        throw std::runtime_error("Height patch doesn't fit inside the grid");
+    }
+    if (heights.size() != static_cast<size_t>(patchRows) * patchColumns) {
+        throw std::runtime_error("Height patch should have " + std::to_string(patchRows * patchColumns) +
+                                 " heights, but has " + std::to_string(heights.size()));
+    }
+
+    size_t index = 0;
+    for (int row = row0; row < row0 + patchRows; row++) {
+        for (int column = column0; column < column0 + patchColumns; column++) {
+            heights_[latticeIndex(row, column)] = heights[index++];
+        }
+    }
+    GridRegion dirty(row0, column0, row0 + patchRows - 1, column0 + patchColumns - 1);
+    deriveSurface(dirty, true);
+    setLatticePoints(dirty);
+    return dirty;
+}
+
+size_t Grid::latticeIndex(int row, int column) const {
+    if (layout_ == LatticeLayout::Tiled) {
+        const size_t tile = static_cast<size_t>(row / latticeTileSize) * tileColumns_ + column / latticeTileSize;
+        return (tile * latticeTileSize + row % latticeTileSize) * latticeTileSize + column % latticeTileSize;
+    }
+    return static_cast<size_t>(columns_ + 1) * row + column;
+}
+
+size_t Grid::latticeSize() const {
+    if (layout_ == LatticeLayout::Tiled) {
+        const size_t tileRows = (rows_ + latticeTileSize) / latticeTileSize;
+        return tileRows * tileColumns_ * latticeTileSize * latticeTileSize;
+    }
+    return static_cast<size_t>(rows_ + 1) * (columns_ + 1);
+}
+
+LatticeLayout Grid::latticeLayout() const {
+    return layout_;
+}
+
+void Grid::setLatticeLayout(LatticeLayout layout) {
+    if (layout == layout_) {
+        return;
+    }
+
+    // Note where every point is now, then move each array's entries over.
+    std::vector<size_t> from(static_cast<size_t>(rows_ + 1) * (columns_ + 1));
+    for (int row = 0; row <= rows_; row++) {
+        for (int column = 0; column <= columns_; column++) {
+            from[static_cast<size_t>(row) * (columns_ + 1) + column] = latticeIndex(row, column);
+        }
+    }
+    layout_ = layout;
+    auto reorder = [this, &from] (auto& values) {
+        std::remove_reference_t<decltype(values)> moved(latticeSize());
+        for (int row = 0; row <= rows_; row++) {
+            for (int column = 0; column <= columns_; column++) {
+                moved[latticeIndex(row, column)] = values[from[static_cast<size_t>(row) * (columns_ + 1) + column]];
+            }
+        }
+        values.swap(moved);
     };
+    reorder(positions_);
+    reorder(heights_);
+    reorder(slopes_);
+    reorder(temperatures_);
+    reorder(aspects_);
+    reorder(roughness_);
+    reorder(colors_);
+
+    // The triangle planes are kept per cell, so only the indices change.
+    triangleIndices_ = sharedTriangleIndices(*this);
+    lod.build(*this);
+}
 
-    // Calculate the four corners of the current "patch".
-    // Patch is the current grid cell the point (u, v) is in.
-    GridPoint ul = lattice.at(index(floor(column), floor(row)));
-    const double u_ul = floor(u / rows_) * rows_;
-    const double v_ul = floor(u / columns_) * columns_;
+const Point* Grid::positions() const {
+    return positions_.data();
+}
 
-    GridPoint ur = lattice.at(index(ceil(column), floor(row)));
-    const double u_ur = floor(u / rows_) * rows_;
-    const double v_ur = ceil(u / columns_) * columns_;
+Matrix Grid::modelMatrix() const {
+    return modelMatrix_;
+}
 
-    GridPoint ll = lattice.at(index(floor(column), ceil(row)));
-    const double u_ll = ceil(u / rows_) * rows_;
-    const double v_ll = floor(u / columns_) * columns_;
+double* Grid::heights() {
+    return heights_.data();
+}
 
-    GridPoint lr = lattice.at(index(ceil(column), ceil(row)));
-    const double u_lr = ceil(u / rows_) * rows_;
-    const double v_lr = ceil(u / columns_) * columns_;
+const double* Grid::heights() const {
+    return heights_.data();
+}
 
-    // Calculate upper horizontal parameter of interpolation.
-    const double s_top = (v - v_ul) / (v_ur - v_ul);
+double* Grid::slopes() {
+    return slopes_.data();
+}
 
-    // Calculate lower horizontal parameter of interpolation.
-    const double s_bottom = (v - v_ll) / (v_lr - v_ll);
+const double* Grid::slopes() const {
+    return slopes_.data();
+}
 
-    // Calculate vertical parameter of interpolation.
-    const double r = (u - u_ul) / (u_ll - u_ul);
+double* Grid::temperatures() {
+    return temperatures_.data();
+}
 
-    Point upper = ul + s_top * (ur - ul);
-    Point lower = ll + s_bottom * (lr - ll);
+const double* Grid::temperatures() const {
+    return temperatures_.data();
+}
 
-    Point resultPoint = upper + r * (lower - upper);
+const double* Grid::aspects() const {
+    return aspects_.data();
+}
 
+const double* Grid::roughness() const {
+    return roughness_.data();
+}
 
-    return resultPoint;
+SDL_Color* Grid::colors() {
+    return colors_.data();
+}
 
+const SDL_Color* Grid::colors() const {
+    return colors_.data();
 }
 
-void Grid::apply(const Matrix& transformationMatrix) {
-    // Change the basis.
-    system_.apply(transformationMatrix);
+std::shared_ptr<const std::vector<uint32_t>> Grid::rowMajorTriangleIndices(int rows, int columns) {
+    return sharedTriangleIndices(rows, columns, LatticeLayout::RowMajor, [columns] (int row, int column) {
+        return static_cast<size_t>(columns + 1) * row + column;
+    });
+}
 
-    // Change the lattice points.
-    setLatticePoints();
+const std::vector<uint32_t>& Grid::triangleIndices() const {
+    return *triangleIndices_;
 }
 
-std::vector<Polygon> Grid::facetize() const {
-    std::vector<Polygon> bag;
-    for (int row = 0; row <= rows_ - 1; row++) {
-        for (int column = 0; column <= columns_ - 1; column++) {
-            int ul_index = column + (columns_ + 1) * row;
-            int ur_index = 1 + ul_index;
-            int ll_index = column + (columns_ + 1) * (row + 1);
-            int lr_index = 1 + ll_index;
-            Polygon triangleA = Polygon(lattice, {ul_index, ur_index, ll_index});
-            bag.push_back(triangleA);
-            Polygon triangleB = Polygon(lattice, {lr_index, ur_index, ll_index});
-            bag.push_back(triangleB);
-        }
-    }
-    return bag;
+GridPoint Grid::latticePoint(int row, int column) const {
+    const size_t index = latticeIndex(row, column);
+    return GridPoint(modelMatrix_ * positions_[index], colors_[index], temperatures_[index], slopes_[index], heights_[index],
+                     aspects_[index], roughness_[index]);
 }
 
-void Grid::setHeight(int row, int column, double newHeight) {
-    int index = column + columns_ * row;
-    lattice.at(index).height = newHeight;
+void Grid::updateLattice() {
+    deriveSurface(GridRegion(0, 0, rows_, columns_), false);
     setLatticePoints();
 }
 
-double Grid::getHeight(int row, int column) const {
-    int index = column + columns_ * row;
-    return lattice.at(index).height;
+void Grid::updateLattice(const GridRegion& region) {
+    deriveSurface(region, false);
+    setLatticePoints(region);
 }
@@ -1,17 +1,27 @@
 #ifndef GRID_H_INCLUDED
 #define GRID_H_INCLUDED
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <functional>
+#include <limits>
+#include <optional>
 #include <tuple>
 
 #include "SDL.h"
 #include "point.h"
 #include "vector.h"
 #include "basis.h"
+#include "matrix.h"
 #include "plane.h"
 #include "render.h"
 #include "polygon.h"
+#include "terrain_lod.h"
+#include "height_pyramid.h"
+#include "thread_pool.h"
+
+class TerrainFile;
 
 struct GridPoint : public Point {
     // We don't need elevation variable, we have this->y
@@ -19,11 +29,61 @@ struct GridPoint : public Point {
     double temperatureKelvin;
     double slopeDeg;
     double height;
+    double aspectDeg;
+    double roughness;
 
     GridPoint();
-    GridPoint(Point p, SDL_Color color_, double temperatureKelvin_, double slopeDeg_, double height_);
+    GridPoint(Point p, SDL_Color color_, double temperatureKelvin_, double slopeDeg_, double height_,
+              double aspectDeg_ = 0, double roughness_ = 0);
+};
+
+// A rectangle of lattice points, from (row0, column0) to (row1, column1)
+// inclusive.  A default-constructed region is empty.
+struct GridRegion {
+    int row0, column0, row1, column1;
+
+    GridRegion();
+    GridRegion(int row0_, int column0_, int row1_, int column1_);
+    bool empty() const;
+
+    // Grows the region just enough to contain the given lattice point.
+    void include(int row, int column);
+};
+
+// One height change for Grid::setHeights().
+struct HeightEdit {
+    int row;
+    int column;
+    double height;
 };
 
+// A ray for Grid::castRays().  The direction doesn't need to be normalized.
+struct Ray {
+    Point origin;
+    Vector direction;
+};
+
+// Where a ray hit the terrain.
+struct RayHit {
+    Point point;
+    int row, column;    // The upper left lattice point of the cell that was hit
+    double distance;    // From the ray's origin to point
+};
+
+// How the lattice arrays of a Grid are ordered.
+enum class LatticeLayout {
+    // Row by row.
+    RowMajor,
+    // In square tiles of latticeTileSize x latticeTileSize points, stored
+    // one after another row by row, each one row by row inside.  Points that
+    // are close on the lattice are then mostly close in memory too.
+    Tiled
+};
+
+// The side of a tile of the tiled lattice layout.  A row of a tile of
+// doubles fills one 64 byte cache line.
+const int latticeTileSize = 8;
+
 class Grid {
     public:
         Grid();
@@ -35,6 +95,15 @@ class Grid {
         // - cellSize: the space between grid cells according to the grid's own basis
         Grid(int rows, int columns, double cellSize = 1.0 );
 
+        // Construct a grid from a memory-mapped terrain cache.  The cached
+        // arrays are copied straight into the lattice without any parsing.
+        //
+        // A stride greater than 1 keeps only every stride-th row and column,
+        // which gives a coarse overview of terrain too big to hold in full.
+        // Its lattice points stay where they are in the full terrain, even
+        // when the last partial stride of rows or columns is dropped.
+        explicit Grid(const TerrainFile& terrain, int stride = 1);
+
         // This is for representing a position in the grid using a sum of multiples of the three axes.
         Basis system() const;
 
@@ -49,11 +118,89 @@ class Grid {
 
         // A setter that allows you to change the height of mutable grids.
         void setHeight(int row, int column, double newHeight);
+
+        // Changes many heights at once.  Only the lattice positions around
+        // the edited points are recomputed, so this costs about the same
+        // whether the grid is small or huge.
+        //
+        // Returns the lattice points that changed.  Throws
+        // std::runtime_error if an edit is outside the grid.
+        GridRegion setHeights(const std::vector<HeightEdit>& edits);
+
+        // Overwrites a rectangular patch of patchRows x patchColumns lattice
+        // points whose upper left corner is at (row0, column0).  The heights
+        // are given row by row.
+        GridRegion setHeights(int row0, int column0, int patchRows, int patchColumns,
+                              const std::vector<double>& heights);
+
         // A getter that allows you to get the height of grid points in const grids.
         double getHeight(int row, int column) const;
 
-
-        // Have 3D grid points displayed in 2D
+        // The lattice is stored as one array per attribute, each holding
+        // latticeSize() entries in the order given by latticeLayout().  Use
+        // latticeIndex() to find a point's entry in the arrays.  A row-major
+        // lattice has exactly (rows() + 1) * (columns() + 1) entries, while a
+        // tiled one is padded out to whole tiles.
+        std::size_t latticeIndex(int row, int column) const;
+        std::size_t latticeSize() const;
+
+        // Grids start out row-major.  Changing the layout reorders every
+        // lattice array, so indices taken before the change are invalid.
+        LatticeLayout latticeLayout() const;
+        void setLatticeLayout(LatticeLayout layout);
+
+        // The position of every lattice point in the grid's own coordinates,
+        // with the center at the origin, the columns along x, the heights
+        // along y and the rows along z.  modelMatrix() takes them to world
+        // space.  These follow from the heights, so they're only updated by
+        // updateLattice().
+        const Point* positions() const;
+
+        // Maps the grid's own coordinates to world space.
+        Matrix modelMatrix() const;
+
+        // Gives bulk loaders direct access to the lattice attributes.  Call
+        // updateLattice() once all of the heights have been written.
+        double* heights();
+        const double* heights() const;
+        double* slopes();
+        const double* slopes() const;
+        double* temperatures();
+        const double* temperatures() const;
+
+        // Derived from the heights whenever they change (see
+        // deriveSurface()): the compass direction that each lattice point's
+        // slope faces, and the height range of its 3 x 3 neighborhood.
+        const double* aspects() const;
+        const double* roughness() const;
+        SDL_Color* colors();
+        const SDL_Color* colors() const;
+
+        // The full resolution mesh, as triplets of indices into positions():
+        // two triangles per cell, row by row, split as in facetize().  Grids
+        // with the same dimensions share one index buffer.
+        const std::vector<std::uint32_t>& triangleIndices() const;
+
+        // The same indices for any row-major lattice of rows x columns cells,
+        // such as a CompactTile's, shared with the grids of that size.
+        static std::shared_ptr<const std::vector<std::uint32_t>> rowMajorTriangleIndices(int rows, int columns);
+
+        // Gathers all of one lattice point's attributes.  Loops over many
+        // points should use the arrays above instead.
+        GridPoint latticePoint(int row, int column) const;
+
+        // Recomputes the lattice positions after heights were changed
+        // through heights().  Slopes written through slopes() are kept, so
+        // that measured slopes survive loading.
+        void updateLattice();
+
+        // The same, but only for the given lattice points.
+        void updateLattice(const GridRegion& region);
+
+
+        // Have 3D grid points displayed in 2D, in the renderer's style.  Only
+        // the triangles of the level of detail chosen for the renderer's
+        // camera are drawn.
         void render(const Renderer& r) const;
 
 
@@ -80,6 +227,33 @@ class Grid {
                                      return SDL_Color{255, 255, 255, 255};
                                  });
 
+        // The same, but the functions are inlined and the rows are split
+        // across the thread pool, so both functions must be safe to call
+        // from several threads at once.
+        template <typename HeightFunction, typename ColorFunction>
+        void setHeightByFunction(HeightFunction zCoordinateFunc, ColorFunction colorFunc) {
+            getThreadPool().parallelFor(0, rows_ + 1, [&] (int firstRow, int lastRow) {
+                for (int row = firstRow; row < lastRow; row++) {
+                    const double y = normalizedRow(row);
+                    for (int column = 0; column <= columns_; column++) {
+                        const double x = normalizedColumn(column);
+                        const std::size_t index = latticeIndex(row, column);
+                        heights_[index] = zCoordinateFunc(x, y);
+                        colors_[index] = colorFunc(x, y);
+                    }
+                }
+            });
+            deriveSurface(GridRegion(0, 0, rows_, columns_), true);
+            setLatticePoints();
+        }
+
+        template <typename HeightFunction>
+        void setHeightByFunction(HeightFunction zCoordinateFunc) {
+            setHeightByFunction(zCoordinateFunc, [] (double, double) {
+                return SDL_Color{255, 255, 255, 255};
+            });
+        }
+
         // Gets the parameters of surface interpolation for the given point
         //
         // Returns a triplet of floating point numbers:
@@ -93,29 +267,123 @@ class Grid {
         // Lower left = (1, 0)
         //
         // Can return valid data for points outside the grid.
+        //
+        // This is a single multiplication by a matrix that is cached
+        // whenever the grid moves, so it is cheap enough to call per frame.
         std::tuple<double, double, double> gridLocation(Point p) const;
 
-        // Uses averages of the nearest grid points to u and v, and determines
-        // where the "floor" should be, even when u and v don't directly
-        // correspond to a grid point boundary.
+        // The same for many points at once.
+        std::vector<std::tuple<double, double, double>> gridLocation(const std::vector<Point>& points) const;
+
+        // Finds the point on the drawn surface above or below (u, v), even
+        // when u and v don't directly correspond to a grid point boundary.
         //
         // 0 <= v <= 1
         // 0 <= u <= 1
         Point findFloor(double u, double v) const;
 
-        // Applies matrix to the entire grid
+        // The height of the drawn surface at (u, v), measured along the
+        // grid's axisY like getHeight().  Each cell is split into the same
+        // two triangles as facetize(), and the height comes from the cached
+        // plane of the triangle containing (u, v), so this is exact and O(1).
+        double floorHeight(double u, double v) const;
+
+        // The unit normal of the triangle containing (u, v), pointing to the
+        // same side of the grid as axisY.
+        Vector floorNormal(double u, double v) const;
+
+        // Samples floorHeight() at count points, and floorNormal() too if
+        // normals isn't null.  When built with AVX2 (the ALTITUTION_AVX2
+        // option in CMakeLists.txt) four points are sampled at a time;
+        // otherwise this is a plain loop over the calls above.
+        void floorHeights(const double* u, const double* v, std::size_t count,
+                          double* heights, Vector* normals = nullptr) const;
+
+        // Finds the first point where the ray origin + t * direction, t >= 0,
+        // hits the drawn surface within maxDistance of its origin.  Returns
+        // nullopt if it misses the terrain.
+        std::optional<RayHit> castRay(Point origin, Vector direction,
+                                      double maxDistance = std::numeric_limits<double>::infinity()) const;
+
+        // The same for many rays at once, split across the thread pool.
+        std::vector<std::optional<RayHit>> castRays(const std::vector<Ray>& rays,
+                                                    double maxDistance = std::numeric_limits<double>::infinity()) const;
+
+        // Applies matrix to the entire grid.  Only the basis changes, so this
+        // costs the same however big the grid is.
         void apply(const Matrix& transformationMatrix);
 
-        // Takes in vertices and spits out triangles.
+        // Takes in vertices and spits out triangles.  This copies every
+        // vertex into its own Polygon, so it is only meant for debugging;
+        // use positions() and triangleIndices() instead.
         std::vector<Polygon> facetize() const;
 
     private:
-        std::vector<GridPoint> lattice;
+        // The lattice, as a structure of arrays so that loops which only
+        // need positions stream 24 bytes per point instead of all of them.
+        std::vector<Point> positions_;
+        std::vector<double> heights_;
+        std::vector<double> slopes_;
+        std::vector<double> temperatures_;
+        std::vector<double> aspects_;
+        std::vector<double> roughness_;
+        std::vector<SDL_Color> colors_;
         Basis system_;
         int rows_, columns_;
         double cellSize_;
-        std::vector<Polygon> triangles;
+        LatticeLayout layout_;
+        int tileColumns_;               // Tiles per row of tiles, when tiled
+        // Maps world space to (v, signed height, u), and the unit normal of
+        // gridPlane().  Both follow system_, so setGridTransform() has to be
+        // called whenever it changes.
+        Matrix worldToGrid_;
+        Vector gridNormal_;
+        // Maps world space to lattice space (column, height, row), in which
+        // the rows and columns are whole numbers at the lattice points.
+        Matrix worldToLattice_;
+        // Maps the grid's own coordinates to world space and back, and takes
+        // local normals to world space.
+        Matrix modelMatrix_;
+        Matrix worldToLocal_;
+        Matrix normalToWorld_;
+        std::shared_ptr<const std::vector<std::uint32_t>> triangleIndices_;
+        // One plane and unit normal per triangle, in the same order as
+        // triangleIndices(), kept up to date with the positions.
+        std::vector<Plane> trianglePlanes_;
+        std::vector<Vector> triangleNormals_;
+        // Selecting a level of detail is part of drawing, so it may change
+        // even when the grid is const.
+        mutable TerrainLod lod;
+        HeightPyramid heightPyramid;
         void setLatticePoints();
+        void setLatticePoints(const GridRegion& region);
+
+        void setGridTransform();
+
+        // Computes the aspect and roughness of every lattice point whose 3 x 3
+        // neighborhood overlaps the region, and the slope too if deriveSlopes
+        // is set.  Slopes and aspects come from Horn's stencil, which weighs
+        // the nearest neighbors twice as heavily as the diagonal ones.
+        void deriveSurface(const GridRegion& region, bool deriveSlopes);
+
+        // Sizes the lattice arrays for the current dimensions.
+        void allocateLattice();
+
+        // A row or column as a fraction of the way across the grid, from 0 to 1.
+        double normalizedRow(int row) const;
+        double normalizedColumn(int column) const;
+
+        // Where the lattice point would be in the grid's own coordinates at
+        // the given height.
+        // Fractional rows and columns give points between lattice points.
+        Point latticePosition(double row, double column, double height) const;
+
+        // Recomputes the planes of the triangles in the given cells, where
+        // cell (row, column) has lattice point (row, column) at its upper left.
+        void setTrianglePlanes(int cellRow0, int cellColumn0, int cellRow1, int cellColumn1);
+
+        // The index into trianglePlanes_ of the triangle containing (u, v).
+        std::size_t triangleAt(double u, double v) const;
 
 
 
@@ -0,0 +1,225 @@
+#include "height_pyramid.h"
+#include "grid.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace {
+    // The part [t0, t1] of the ray origin + t * direction that lies between
+    // low and high along one axis.  Leaves t0 > t1 if there is none.
+    void clipSlab(double origin, double direction, double low, double high, double& t0, double& t1) {
+        if (direction == 0) {
+            if (origin < low || origin > high) {
+                t0 = 1;
+                t1 = 0;
+            }
+            return;
+        }
+        double near = (low - origin) / direction;
+        double far = (high - origin) / direction;
+        if (near > far) {
+            swap(near, far);
+        }
+        t0 = max(t0, near);
+        t1 = min(t1, far);
+    }
+
+    // Moller-Trumbore: the t at which the ray hits triangle (a, b, c), or
+    // nullopt if it misses.  Hits on the triangle's edges count, so that
+    // rays can't slip between neighboring triangles.
+    optional<double> intersectTriangle(Point origin, Vector direction, Point a, Point b, Point c) {
+        const double tolerance = 1e-9;
+        const Vector ab = b - a;
+        const Vector ac = c - a;
+        const Vector p = crossProduct(direction, ac);
+        const double determinant = dotProduct(ab, p);
+        if (abs(determinant) < 1e-12) {
+            return nullopt;
+        }
+        const Vector toOrigin = origin - a;
+        const double s = dotProduct(toOrigin, p) / determinant;
+        if (s < -tolerance || s > 1 + tolerance) {
+            return nullopt;
+        }
+        const Vector q = crossProduct(toOrigin, ab);
+        const double r = dotProduct(direction, q) / determinant;
+        if (r < -tolerance || s + r > 1 + tolerance) {
+            return nullopt;
+        }
+        return dotProduct(ac, q) / determinant;
+    }
+}
+
+HeightPyramid::HeightPyramid() : rows_(0), columns_(0) {}
+
+void HeightPyramid::build(const Grid& grid) {
+    rows_ = static_cast<int>(grid.rows());
+    columns_ = static_cast<int>(grid.columns());
+    levels.clear();
+    if (rows_ <= 0 || columns_ <= 0) {
+        return;
+    }
+
+    int rows = rows_, columns = columns_;
+    while (true) {
+        Level level;
+        level.rows = rows;
+        level.columns = columns;
+        level.low.assign(static_cast<size_t>(rows) * columns, 0);
+        level.high.assign(static_cast<size_t>(rows) * columns, 0);
+        levels.push_back(move(level));
+        if (rows == 1 && columns == 1) {
+            break;
+        }
+        rows = (rows + 1) / 2;
+        columns = (columns + 1) / 2;
+    }
+
+    // Level 0 is most of the work, and its rows are independent.
+    getThreadPool().parallelFor(0, rows_, [&] (int firstRow, int lastRow) {
+        measure(grid, 0, firstRow, 0, lastRow - 1, columns_ - 1);
+    });
+    for (size_t level = 1; level < levels.size(); level++) {
+        measure(grid, level, 0, 0, levels[level].rows - 1, levels[level].columns - 1);
+    }
+}
+
+void HeightPyramid::update(const Grid& grid, const GridRegion& region) {
+    if (region.empty() || levels.empty()) {
+        return;
+    }
+
+    // A lattice point is a corner of the cells above and to the left of it.
+    int row0 = max(region.row0 - 1, 0);
+    int column0 = max(region.column0 - 1, 0);
+    int row1 = min(region.row1, rows_ - 1);
+    int column1 = min(region.column1, columns_ - 1);
+    for (size_t level = 0; level < levels.size(); level++) {
+        measure(grid, level, row0, column0, row1, column1);
+        row0 /= 2;
+        column0 /= 2;
+        row1 /= 2;
+        column1 /= 2;
+    }
+}
+
+void HeightPyramid::measure(const Grid& grid, int level, int row0, int column0, int row1, int column1) {
+    Level& blocks = levels[level];
+    const double* heights = grid.heights();
+    for (int row = row0; row <= row1; row++) {
+        for (int column = column0; column <= column1; column++) {
+            double low, high;
+            if (level == 0) {
+                const double corners[4] = {
+                    heights[grid.latticeIndex(row, column)],
+                    heights[grid.latticeIndex(row, column + 1)],
+                    heights[grid.latticeIndex(row + 1, column)],
+                    heights[grid.latticeIndex(row + 1, column + 1)]
+                };
+                low = *min_element(corners, corners + 4);
+                high = *max_element(corners, corners + 4);
+            } else {
+                const Level& below = levels[level - 1];
+                low = numeric_limits<double>::infinity();
+                high = -numeric_limits<double>::infinity();
+                for (int childRow = 2 * row; childRow <= min(2 * row + 1, below.rows - 1); childRow++) {
+                    for (int childColumn = 2 * column; childColumn <= min(2 * column + 1, below.columns - 1); childColumn++) {
+                        const size_t child = static_cast<size_t>(childRow) * below.columns + childColumn;
+                        low = min(low, below.low[child]);
+                        high = max(high, below.high[child]);
+                    }
+                }
+            }
+            const size_t block = static_cast<size_t>(row) * blocks.columns + column;
+            blocks.low[block] = low;
+            blocks.high[block] = high;
+        }
+    }
+}
+
+optional<tuple<double, int, int>> HeightPyramid::castRay(const Grid& grid, Point origin, Vector direction,
+                                                         double maxT) const {
+    if (levels.empty()) {
+        return nullopt;
+    }
+    const double* heights = grid.heights();
+    auto corner = [&grid, heights] (int row, int column) {
+        return Point(column, heights[grid.latticeIndex(row, column)], row);
+    };
+
+    struct Block {
+        int level, row, column;
+    };
+    // Each level adds at most three blocks waiting behind the one being
+    // descended into, and there are at most 32 levels.
+    Block stack[3 * 32 + 1];
+    int stackSize = 0;
+    stack[stackSize++] = Block{static_cast<int>(levels.size()) - 1, 0, 0};
+
+    // Children are visited nearest first, so that most rays stop at the
+    // first block they hit.  The far children are pushed first.
+    const int nearRow = direction.z >= 0 ? 0 : 1;
+    const int nearColumn = direction.x >= 0 ? 0 : 1;
+    const int order[4][2] = {
+        {1 - nearRow, 1 - nearColumn},
+        {1 - nearRow, nearColumn},
+        {nearRow, 1 - nearColumn},
+        {nearRow, nearColumn}
+    };
+
+    optional<tuple<double, int, int>> hit;
+    double bestT = maxT;
+    while (stackSize > 0) {
+        const Block block = stack[--stackSize];
+
+        const int row0 = block.row << block.level;
+        const int column0 = block.column << block.level;
+        const int row1 = min((block.row + 1) << block.level, rows_);
+        const int column1 = min((block.column + 1) << block.level, columns_);
+        double t0 = 0, t1 = bestT;
+        clipSlab(origin.z, direction.z, row0, row1, t0, t1);
+        clipSlab(origin.x, direction.x, column0, column1, t0, t1);
+        if (t0 > t1) {
+            continue;
+        }
+
+        // The ray's height is linear in t, so its extremes over the block
+        // are at the ends.
+        const Level& blocks = levels[block.level];
+        const size_t index = static_cast<size_t>(block.row) * blocks.columns + block.column;
+        const double height0 = origin.y + t0 * direction.y;
+        const double height1 = origin.y + t1 * direction.y;
+        if (min(height0, height1) > blocks.high[index] || max(height0, height1) < blocks.low[index]) {
+            continue;
+        }
+
+        if (block.level == 0) {
+            const Point ul = corner(block.row, block.column);
+            const Point ur = corner(block.row, block.column + 1);
+            const Point ll = corner(block.row + 1, block.column);
+            const Point lr = corner(block.row + 1, block.column + 1);
+            for (auto t : {intersectTriangle(origin, direction, ul, ur, ll),
+                           intersectTriangle(origin, direction, lr, ur, ll)}) {
+                if (t && *t >= 0 && *t <= bestT) {
+                    bestT = *t;
+                    hit = make_tuple(*t, block.row, block.column);
+                }
+            }
+            continue;
+        }
+
+        const Level& below = levels[block.level - 1];
+        for (const auto& child : order) {
+            const int childRow = 2 * block.row + child[0];
+            const int childColumn = 2 * block.column + child[1];
+            if (childRow < below.rows && childColumn < below.columns) {
+                stack[stackSize++] = Block{block.level - 1, childRow, childColumn};
+            }
+        }
+    }
+    return hit;
+}
@@ -0,0 +1,59 @@
+#ifndef HEIGHT_PYRAMID_H_INCLUDED
+#define HEIGHT_PYRAMID_H_INCLUDED
+
+#include <optional>
+#include <tuple>
+#include <vector>
+
+#include "point.h"
+#include "vector.h"
+
+class Grid;
+struct GridRegion;
+
+// A min/max mip hierarchy over a grid's heights, for casting rays at the
+// terrain.
+//
+// Level 0 holds the lowest and highest corner of every cell.  Each following
+// level merges 2 x 2 blocks of the level below, up to a single block covering
+// the whole grid.  A ray descends only into blocks whose height range it
+// passes through, nearest blocks first, so open sky and terrain far below
+// the ray are skipped a whole block at a time.
+//
+// Everything here is in lattice space, where a point is (column, height, row)
+// and cell (row, column) spans [row, row + 1] x [column, column + 1].
+class HeightPyramid {
+    public:
+        HeightPyramid();
+
+        // Measures every block.  This must be called whenever the grid's
+        // heights or dimensions change.
+        void build(const Grid& grid);
+
+        // Re-measures only the blocks that touch the given lattice points,
+        // after their heights changed.  The grid's dimensions must not have
+        // changed since build().
+        void update(const Grid& grid, const GridRegion& region);
+
+        // Finds the first of the grid's triangles hit by origin + t * direction
+        // with 0 <= t <= maxT.  Returns t and the hit cell's row and column.
+        std::optional<std::tuple<double, int, int>> castRay(const Grid& grid, Point origin, Vector direction,
+                                                            double maxT) const;
+
+    private:
+        struct Level {
+            int rows, columns;           // Blocks in this level
+            std::vector<double> low;     // Lowest and highest height in each block, row by row
+            std::vector<double> high;
+        };
+
+        int rows_, columns_;             // Cells in the grid
+        std::vector<Level> levels;
+
+        // Recomputes the blocks in rows [row0, row1] and columns [column0,
+        // column1] of a level from the level below, or from the grid for
+        // level 0.
+        void measure(const Grid& grid, int level, int row0, int column0, int row1, int column1);
+};
+
+#endif // HEIGHT_PYRAMID_H_INCLUDED
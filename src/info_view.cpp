@@ -2,30 +2,39 @@
 #include "asset_manager.h"
 #include "SDL.h"
 
-InfoView::InfoView(SDL_Rect infoBoundary, int deltaX, int deltaY) {
-    std::string infoText = "Info";
+#include <cstdio>
+
+InfoView::InfoView(SDL_Rect infoBoundary, int deltaX, int deltaY)
+    : infoText_("Info"), height_(0), slopeDeg_(0) {
     boundaryInfoView = infoBoundary;
-    const AssetManager& am = getAssetManager();
-    TTF_Font* infoFont = am.getFont("gidole");
-    renderText = TTF_RenderUTF8_Shaded(infoFont, infoText.c_str(), SDL_Color{255, 255, 255, 255}, SDL_Color{255, 61, 64});
 }
 
 void InfoView::draw(SDL_Surface* screen) {
     SDL_FillRect(screen, &boundaryInfoView, SDL_MapRGB(screen->format, 255, 61, 64));
 
     // Draw the info text.
-    SDL_Rect rec = SDL_Rect{
-      boundaryInfoView.x + boundaryInfoView.w / 2 - renderText->w / 2 ,
-      boundaryInfoView.y + boundaryInfoView.h / 8 - renderText->h / 2,
-      0 /* ignored */,
-      0 /* ignored */
-    };
-    SDL_BlitSurface(renderText,
-                    nullptr,
-                    screen,
-                    &rec);
+    const GlyphAtlas& atlas = getAssetManager().getGlyphAtlas("gidole");
+    const SDL_Color textColor = SDL_Color{255, 255, 255, 255};
+    int y = boundaryInfoView.y + boundaryInfoView.h / 8 - atlas.lineHeight() / 2;
+    atlas.draw(screen, infoText_,
+               boundaryInfoView.x + boundaryInfoView.w / 2 - atlas.textWidth(infoText_) / 2,
+               y, textColor);
+
+    // Draw the readouts below it, one per line.
+    char line[64];
+    snprintf(line, sizeof(line), "%.1f m", height_);
+    y += atlas.lineHeight();
+    atlas.draw(screen, line, boundaryInfoView.x + boundaryInfoView.w / 2 - atlas.textWidth(line) / 2, y, textColor);
+    snprintf(line, sizeof(line), "%.1f deg", slopeDeg_);
+    y += atlas.lineHeight();
+    atlas.draw(screen, line, boundaryInfoView.x + boundaryInfoView.w / 2 - atlas.textWidth(line) / 2, y, textColor);
 }
 
 SDL_Rect InfoView::boundary() const {
     return boundaryInfoView;
 }
+
+void InfoView::setTelemetry(double height, double slopeDeg) {
+    height_ = height;
+    slopeDeg_ = slopeDeg;
+}
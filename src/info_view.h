@@ -12,10 +12,15 @@ class InfoView : public View {
         void draw(SDL_Surface* screen);
         SDL_Rect boundary() const;
         // void handleResize(SDL_Surface* screen);
+
+        // Updates the live readouts under the title.  These are cheap enough
+        // to call every frame.
+        void setTelemetry(double height, double slopeDeg);
     private:
         SDL_Rect boundaryInfoView;
         std::string infoText_;
-        SDL_Surface* renderText;
+        double height_;
+        double slopeDeg_;
 };
 
 
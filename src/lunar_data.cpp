@@ -0,0 +1,114 @@
+#include "lunar_data.h"
+#include "mapped_file.h"
+#include "terrain_file.h"
+#include "terrain_resampler.h"
+
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+    // Copies every sample in the file into the lattice, row by row.
+    void fillGrid(const MappedFile& file, Grid& grid) {
+        double* heights = grid.heights();
+        double* slopes = grid.slopes();
+        const int columns = static_cast<int>(grid.columns()) + 1;
+        int row = 0, column = 0;
+        parseLunarCsv(file.begin(), file.end(), [&] (const LunarSample& sample) {
+            const size_t index = grid.latticeIndex(row, column);
+            heights[index] = sample.height;
+            slopes[index] = sample.slope;
+            if (++column == columns) {
+                column = 0;
+                row++;
+            }
+        });
+        grid.updateLattice();
+    }
+}
+
+size_t countLunarSamples(const char* begin, const char* end) {
+    using namespace lunar_csv_detail;
+    size_t count = 0;
+    const char* p = begin;
+    while (p < end) {
+        const char* lineEnd = endOfLine(p, end);
+        const char* first = skipBlanks(p, lineEnd);
+        if (first < lineEnd && startsNumber(*first)) {
+            count++;
+        }
+        p = lineEnd + 1;
+    }
+    return count;
+}
+
+vector<LunarSample> readLunarSamples(const string& fileName) {
+    MappedFile file(fileName);
+    file.adviseSequential();
+
+    vector<LunarSample> samples;
+    samples.reserve(countLunarSamples(file.begin(), file.end()));
+    parseLunarCsv(file.begin(), file.end(), [&samples] (const LunarSample& sample) {
+        samples.push_back(sample);
+    });
+    return samples;
+}
+
+void loadLunarCsv(const string& fileName, Grid& grid) {
+    MappedFile file(fileName);
+    file.adviseSequential();
+
+    // Counting is just a memchr() per line, so it is cheap compared to
+    // parsing, and it lets us refuse a mismatched file before touching the grid.
+    const size_t expected = static_cast<size_t>(grid.rows() + 1) * static_cast<size_t>(grid.columns() + 1);
+    const size_t count = countLunarSamples(file.begin(), file.end());
+    if (count != expected) {
+        throw runtime_error(fileName + " has " + to_string(count) + " samples, but the grid has " +
+                            to_string(expected) + " lattice points");
+    }
+    fillGrid(file, grid);
+}
+
+Grid loadLunarCsv(const string& fileName, double cellSize) {
+    MappedFile file(fileName);
+    file.adviseSequential();
+
+    const size_t count = countLunarSamples(file.begin(), file.end());
+    const int side = static_cast<int>(llround(sqrt(static_cast<double>(count))));
+    if (count < 4 || static_cast<size_t>(side) * side != count) {
+        throw runtime_error(fileName + " has " + to_string(count) + " samples, which is not a square lattice");
+    }
+
+    Grid grid(side - 1, side - 1, cellSize);
+    fillGrid(file, grid);
+    return grid;
+}
+
+optional<Grid> loadLunarTerrain(const string& csvFileName, const string& cacheFileName) {
+    try {
+        TerrainFile cache(cacheFileName);
+        if (!cache.isStaleFor(csvFileName)) {
+            return Grid(cache);
+        }
+        cout << "Terrain cache is out of date with " << csvFileName << "\n";
+    } catch (const runtime_error& e) {
+        cout << "Terrain cache unavailable (" << e.what() << ")\n";
+    }
+
+    optional<Grid> grid;
+    try {
+        grid = resampleLunarSamples(readLunarSamples(csvFileName));
+    } catch (const runtime_error& e) {
+        cout << "Could not load lunar data (" << e.what() << ")\n";
+        return nullopt;
+    }
+
+    try {
+        writeTerrainFile(cacheFileName, *grid, csvFileName);
+    } catch (const runtime_error& e) {
+        // We still have the terrain; we'll just have to parse it again next time.
+        cout << "Could not write terrain cache (" << e.what() << ")\n";
+    }
+    return grid;
+}
@@ -0,0 +1,108 @@
+#ifndef LUNAR_DATA_H_INCLUDED
+#define LUNAR_DATA_H_INCLUDED
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <optional>
+#include <vector>
+#include <stdexcept>
+#include <string>
+
+#include "grid.h"
+
+// One row of the NASA lunar south pole data file.
+struct LunarSample {
+    double latitude;  // Degrees
+    double longitude; // Degrees
+    double height;    // Meters
+    double slope;     // Degrees
+};
+
+namespace lunar_csv_detail {
+    inline bool startsNumber(char c) {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+    }
+
+    inline const char* skipBlanks(const char* p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+        return p;
+    }
+
+    inline const char* endOfLine(const char* p, const char* end) {
+        const void* newline = std::memchr(p, '\n', end - p);
+        return newline ? static_cast<const char*>(newline) : end;
+    }
+
+    // Parses one comma-separated number starting at p and leaves p just past
+    // the separator that follows it.
+    inline double parseField(const char*& p, const char* lineEnd) {
+        p = skipBlanks(p, lineEnd);
+        if (p < lineEnd && *p == '+') {
+            // from_chars() doesn't accept a leading plus sign.
+            ++p;
+        }
+        double value;
+        std::from_chars_result result = std::from_chars(p, lineEnd, value);
+        if (result.ec != std::errc()) {
+            throw std::runtime_error("Malformed number in lunar data: \"" +
+                                     std::string(p, std::min<std::ptrdiff_t>(lineEnd - p, 32)) + "\"");
+        }
+        p = skipBlanks(result.ptr, lineEnd);
+        if (p < lineEnd && *p == ',') {
+            ++p;
+        }
+        return value;
+    }
+}
+
+// Parses the lunar CSV text in [begin, end) in place and calls
+// onSample(const LunarSample&) once for every data row, in file order.
+//
+// The expected columns are latitude, longitude, height and slope; extra
+// columns are ignored.  Lines that don't start with a number (such as the
+// header) are skipped.  Throws std::runtime_error on malformed rows.
+template <typename SampleCallback>
+void parseLunarCsv(const char* begin, const char* end, SampleCallback onSample) {
+    using namespace lunar_csv_detail;
+    const char* p = begin;
+    while (p < end) {
+        const char* lineEnd = endOfLine(p, end);
+        const char* first = skipBlanks(p, lineEnd);
+        if (first < lineEnd && startsNumber(*first)) {
+            LunarSample sample;
+            sample.latitude = parseField(first, lineEnd);
+            sample.longitude = parseField(first, lineEnd);
+            sample.height = parseField(first, lineEnd);
+            sample.slope = parseField(first, lineEnd);
+            onSample(sample);
+        }
+        p = lineEnd + 1;
+    }
+}
+
+// Counts the data rows in [begin, end) without parsing them.
+std::size_t countLunarSamples(const char* begin, const char* end);
+
+// Reads every sample in the lunar data file, in file order.
+std::vector<LunarSample> readLunarSamples(const std::string& fileName);
+
+// Reads the lunar data file into the given grid, filling each lattice point's
+// height and slopeDeg in row-major order.  Throws std::runtime_error unless
+// the file has exactly one row for every lattice point.
+void loadLunarCsv(const std::string& fileName, Grid& grid);
+
+// Reads the lunar data file into a new square grid that has exactly one
+// lattice point per row of the file.
+Grid loadLunarCsv(const std::string& fileName, double cellSize);
+
+// Loads the lunar terrain from its binary cache when one exists and the CSV
+// hasn't changed since it was written.  Otherwise parses the CSV, reprojects
+// its samples onto a lattice (see terrain_resampler.h), and writes the cache
+// so that the next launch can skip all of that.  Returns nullopt when neither
+// file can be read.
+std::optional<Grid> loadLunarTerrain(const std::string& csvFileName, const std::string& cacheFileName);
+
+#endif // LUNAR_DATA_H_INCLUDED
@@ -2,10 +2,33 @@
 #include "asset_manager.h"
 #include "matrix.h"
 
-MainView::MainView(SDL_Surface* screen)
-    : moonView (MoonView(SDL_Rect{(screen->w/10),(screen->h/20),(screen->w*2/3),(screen->h*4/5)}, 0, 0)),
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+    // The lattice's slope at (u, v), interpolated between the four lattice
+    // points around it.
+    double slopeAt(const Grid& grid, double u, double v) {
+        const double row = std::clamp(u, 0.0, 1.0) * grid.rows();
+        const double column = std::clamp(v, 0.0, 1.0) * grid.columns();
+        const int row0 = std::min(static_cast<int>(row), static_cast<int>(grid.rows()) - 1);
+        const int column0 = std::min(static_cast<int>(column), static_cast<int>(grid.columns()) - 1);
+        const double rowFraction = row - row0;
+        const double columnFraction = column - column0;
+        auto slope = [&] (int r, int c) {
+            return grid.slopes()[grid.latticeIndex(r, c)];
+        };
+        return (1 - rowFraction) * ((1 - columnFraction) * slope(row0, column0) + columnFraction * slope(row0, column0 + 1)) +
+               rowFraction * ((1 - columnFraction) * slope(row0 + 1, column0) + columnFraction * slope(row0 + 1, column0 + 1));
+    }
+}
+
+MainView::MainView(SDL_Surface* screen, Grid terrain)
+    : moonView (MoonView(SDL_Rect{(screen->w/10),(screen->h/20),(screen->w*2/3),(screen->h*4/5)}, std::move(terrain), 0, 0)),
       infoView (InfoView(SDL_Rect{(screen->w/10*8),(screen->h/20),(screen->w*1/6),(screen->h*4/5)}, 0, 0)),
 	  navView (NavView(SDL_Rect{10,(screen->h/20),(screen->w*1/12),(screen->h*4/5)}, 0, 0)), 
+      lunarMap (nullptr),
       frameRateView (moonView) {
     boundaryMainView = SDL_Rect{0, 0, screen->w, screen->h};
 
@@ -51,12 +74,22 @@ void MainView::handleResize(SDL_Surface* screen) {
     moonView.setBoundary(moonViewRect);
     this->infoView = InfoView(infoViewRect, 0, 0);
     this->navView = NavView(navViewRect, 0, 0);
+    navView.setMap(lunarMap);
+    this->setCamera(camera);
 
 }
 
 void MainView::setCamera(const Basis& newCamera) {
     camera = newCamera;
     moonView.setCamera(newCamera);
+
+    const Grid& grid = moonView.getGrid();
+    auto [u, v, h] = grid.gridLocation(camera.center);
+    navView.setFocus(u, v);
+
+    // h is measured from the grid's plane; the readout is the height above
+    // the terrain under the camera, and the slope there.
+    infoView.setTelemetry(h - grid.floorHeight(u, v), slopeAt(grid, u, v));
 }
 
 Basis MainView::getCamera() const {
@@ -67,6 +100,15 @@ Grid& MainView::getGrid() {
     return moonView.getGrid();
 }
 
+void MainView::setTerrainPager(const TerrainPager* pager) {
+    moonView.setTerrainPager(pager);
+}
+
+void MainView::setLunarMap(TextureTileCache* map) {
+    lunarMap = map;
+    navView.setMap(map);
+}
+
 void MainView::updateFps(double averageFps) {
     frameRateView.updateFps(averageFps);
 }
\ No newline at end of file
@@ -10,7 +10,7 @@
 
 class MainView : public View {
     public:
-        MainView(SDL_Surface* screen);
+        MainView(SDL_Surface* screen, Grid terrain);
         void draw(SDL_Surface* screen);
         void drawWithRenderer(const Renderer& r);
         SDL_Rect getRenderBoundary() const;
@@ -19,6 +19,8 @@ class MainView : public View {
         void setCamera(const Basis& newCamera);
         Basis getCamera() const;
         Grid& getGrid();
+        void setTerrainPager(const TerrainPager* pager);
+        void setLunarMap(TextureTileCache* map);
         void updateFps(double averageFps);
     private:
         SDL_Rect boundaryMainView;
@@ -26,6 +28,7 @@ class MainView : public View {
         InfoView infoView;
 		NavView navView;
         Basis camera;
+        TextureTileCache* lunarMap;
         FrameRateView frameRateView;
 };
 
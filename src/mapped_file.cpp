@@ -0,0 +1,88 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+MappedFile::MappedFile(const string& fileName) : data_(nullptr), size_(0) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Could not open " + fileName + ": " + strerror(errno));
+    }
+
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0) {
+        string error = strerror(errno);
+        close(fd);
+        throw runtime_error("Could not stat " + fileName + ": " + error);
+    }
+
+    size_ = static_cast<size_t>(fileInfo.st_size);
+    if (size_ > 0) {
+        // mmap() refuses zero-length mappings, so empty files just keep a null data_.
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            string error = strerror(errno);
+            close(fd);
+            throw runtime_error("Could not map " + fileName + ": " + error);
+        }
+        data_ = static_cast<const char*>(mapping);
+    }
+
+    // The mapping keeps its own reference to the file.
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : data_(other.data_), size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+const char* MappedFile::begin() const {
+    return data_;
+}
+
+const char* MappedFile::end() const {
+    return data_ + size_;
+}
+
+size_t MappedFile::size() const {
+    return size_;
+}
+
+void MappedFile::adviseSequential() const {
+    if (data_ != nullptr) {
+        // This is only a hint, so failure is harmless.
+        madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+    }
+}
+
+void MappedFile::unmap() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
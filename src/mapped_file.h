@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_H_INCLUDED
+#define MAPPED_FILE_H_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+// A read-only view of an entire file, mapped into memory so that the operating
+// system pages it in on demand instead of us copying it through a stream.
+//
+// The mapping lives exactly as long as the MappedFile does, so pointers from
+// begin() and end() must not outlive it.
+class MappedFile {
+    public:
+        // Maps the whole file.  Throws std::runtime_error if the file cannot
+        // be opened or mapped.
+        explicit MappedFile(const std::string& fileName);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        const char* begin() const;
+        const char* end() const;
+        std::size_t size() const;
+
+        // Tells the kernel that we will read the file front to back, so it
+        // can read ahead aggressively and drop pages behind us.
+        void adviseSequential() const;
+
+    private:
+        const char* data_;
+        std::size_t size_;
+
+        void unmap();
+};
+
+#endif // MAPPED_FILE_H_INCLUDED
@@ -1,6 +1,10 @@
 #include <iostream>
 #include <cmath>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "matrix.h"
 #include "common.h"
 
@@ -30,7 +34,7 @@ Matrix::Matrix(double a11, double a12, double a13, double a14,
 
 }
 
-Matrix operator*(Matrix m1, Matrix m2) {
+Matrix operator*(const Matrix& m1, const Matrix& m2) {
     Matrix result;
 
     // "k" is the current position in the result array.
@@ -48,7 +52,7 @@ Matrix operator*(Matrix m1, Matrix m2) {
     return result;
 }
 
-std::ostream& operator<<(std::ostream& s, Matrix m) {
+std::ostream& operator<<(std::ostream& s, const Matrix& m) {
     for (int i = 0; i < 16; i += 1) {
         if ((i + 1) % 4 == 0) {
             s << m.data[i] << ", \n";
@@ -59,7 +63,7 @@ std::ostream& operator<<(std::ostream& s, Matrix m) {
     return s;
 }
 
-Vector operator*(Matrix m, Vector v) {
+Vector operator*(const Matrix& m, Vector v) {
     // 0 at end because vectors can't be translated, they don't have a location, just a direction
     const double* const dataPointer = &m.data[0];
     double y = dataPointer[4] * v.x + dataPointer[5] * v.y + dataPointer[6] * v.z + dataPointer[7] * 0;
@@ -75,7 +79,7 @@ Vector operator*(Matrix m, Vector v) {
     return result;
 }
 
-Point operator*(Matrix m, Point p) {
+Point operator*(const Matrix& m, Point p) {
     const double* const dataPointer = &m.data[0];
     double x = dataPointer[0] * p.x + dataPointer[1] * p.y + dataPointer[2] * p.z + dataPointer[3] * 1;
     double y = dataPointer[4] * p.x + dataPointer[5] * p.y + dataPointer[6] * p.z + dataPointer[7] * 1;
@@ -241,3 +245,63 @@ Matrix cameraTransform(Vector X, Vector Y, Vector Z, Point p) {
                                    0, 0, 0, 1);
     return rigidBodyTransformation * p_to_origin;
 }
+
+void projectPoints(const Matrix& m, const Point* points, std::size_t count,
+                   Point* projected, std::uint8_t* inFront) {
+    const double* const d = &m.data[0];
+    std::size_t i = 0;
+
+#ifdef __AVX2__
+    static_assert(sizeof(Point) == 3 * sizeof(double), "Point must be exactly x, y and z");
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d row[16];
+    for (int k = 0; k < 16; k += 1) {
+        row[k] = _mm256_set1_pd(d[k]);
+    }
+    for (; i + 4 <= count; i += 4) {
+        // Four points are three registers of x0 y0 z0 x1 | y1 z1 x2 y2 |
+        // z2 x3 y3 z3.  Blending picks each coordinate's lanes out of them,
+        // and a permute puts the lanes in order.
+        const double* in = &points[i].x;
+        const __m256d a = _mm256_loadu_pd(in);
+        const __m256d b = _mm256_loadu_pd(in + 4);
+        const __m256d c = _mm256_loadu_pd(in + 8);
+        const __m256d x = _mm256_permute4x64_pd(_mm256_blend_pd(_mm256_blend_pd(a, b, 0x4), c, 0x2), 0x6c);
+        const __m256d y = _mm256_permute4x64_pd(_mm256_blend_pd(_mm256_blend_pd(a, b, 0x9), c, 0x4), 0xb1);
+        const __m256d z = _mm256_permute4x64_pd(_mm256_blend_pd(_mm256_blend_pd(a, b, 0x2), c, 0x9), 0xc6);
+
+        auto transformRow = [&] (int k) {
+            return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(row[k], x), _mm256_mul_pd(row[k + 1], y)),
+                                 _mm256_add_pd(_mm256_mul_pd(row[k + 2], z), row[k + 3]));
+        };
+        const __m256d w = transformRow(12);
+        const __m256d px = _mm256_div_pd(transformRow(0), w);
+        const __m256d py = _mm256_div_pd(transformRow(4), w);
+        const __m256d pz = _mm256_div_pd(transformRow(8), w);
+        const int front = _mm256_movemask_pd(_mm256_cmp_pd(w, one, _CMP_GT_OQ));
+        for (int k = 0; k < 4; k += 1) {
+            inFront[i + k] = (front >> k) & 1;
+        }
+
+        // The same permutes undo themselves, and the same blends interleave
+        // the coordinates again.
+        const __m256d sx = _mm256_permute4x64_pd(px, 0x6c);
+        const __m256d sy = _mm256_permute4x64_pd(py, 0xb1);
+        const __m256d sz = _mm256_permute4x64_pd(pz, 0xc6);
+        double* out = &projected[i].x;
+        _mm256_storeu_pd(out, _mm256_blend_pd(_mm256_blend_pd(sx, sy, 0x2), sz, 0x4));
+        _mm256_storeu_pd(out + 4, _mm256_blend_pd(_mm256_blend_pd(sx, sy, 0x9), sz, 0x2));
+        _mm256_storeu_pd(out + 8, _mm256_blend_pd(_mm256_blend_pd(sx, sy, 0x4), sz, 0x9));
+    }
+#endif
+
+    for (; i < count; i += 1) {
+        const Point p = points[i];
+        const double x = d[0] * p.x + d[1] * p.y + d[2] * p.z + d[3];
+        const double y = d[4] * p.x + d[5] * p.y + d[6] * p.z + d[7];
+        const double z = d[8] * p.x + d[9] * p.y + d[10] * p.z + d[11];
+        const double w = d[12] * p.x + d[13] * p.y + d[14] * p.z + d[15];
+        inFront[i] = w > 1;
+        projected[i] = Point(x / w, y / w, z / w);
+    }
+}
@@ -2,6 +2,8 @@
 #define MATRIX_H_INCLUDED
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <ostream>
 
 #include "SDL.h"
@@ -18,10 +20,12 @@ class Matrix {
                double a31, double a32, double a33, double a34,
                double a41, double a42, double a43, double a44);
 
-        friend Matrix operator*(Matrix m1, Matrix m2);
-        friend Vector operator*(Matrix m, Vector v);
-        friend Point operator*(Matrix m, Point p);
-        friend std::ostream& operator<<(std::ostream&, Matrix m);
+        friend Matrix operator*(const Matrix& m1, const Matrix& m2);
+        friend Vector operator*(const Matrix& m, Vector v);
+        friend Point operator*(const Matrix& m, Point p);
+        friend std::ostream& operator<<(std::ostream&, const Matrix& m);
+        friend void projectPoints(const Matrix& m, const Point* points, std::size_t count,
+                                  Point* projected, std::uint8_t* inFront);
     private:
         std::array<double, 16> data;
 };
@@ -55,5 +59,17 @@ Matrix projectionMatrix(double focalDistance, SDL_Rect screenRect, SDL_Rect view
 
 Matrix cameraTransform(Vector X, Vector Y, Vector Z, Point p);
 
+// Multiplies count points by m and divides them by w, writing them to
+// projected, which may be the same array as points.  m is meant to be a
+// projectionMatrix() composed with a camera transform, whose w is
+// 1 + z / focalDistance for the camera space z, so inFront[i] is set to
+// whether w > 1: whether the point is in front of the camera.  Points
+// that aren't come out meaningless, and have to be clipped in camera
+// space instead.
+//
+// When built with AVX2, four points are transformed at a time.
+void projectPoints(const Matrix& m, const Point* points, std::size_t count,
+                   Point* projected, std::uint8_t* inFront);
+
 
 #endif // MATRIX_H_INCLUDED
@@ -1,6 +1,10 @@
 #include "menu_view.h"
 #include "asset_manager.h"
 
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
 const int buttonWidth = 150;
 const int buttonHeight = 75;
 const int displacement = 100;
@@ -13,25 +17,37 @@ MenuView::MenuView(SDL_Surface* surf, int& currentView)
       quitButton (ButtonView(SDL_Rect{(surf->w-buttonWidth)/2, (surf->h-buttonHeight)/2 + displacement, buttonWidth, buttonHeight},
                             "Quit",
                             SDL_Color{112, 191, 255},
-                            [&currentView] () {currentView = -1;})),
-      heroicImage(nullptr) {
+                            [&currentView] () {currentView = -1;})) {
+      // Decoding the background takes a while, so the menu comes up without
+      // it and draws it once it's ready.
       const AssetManager& am = getAssetManager();
-      heroicImage = am.getImage("Apollo_15_flag,_rover,_LM,_Irwin.jpg");
+      heroicImageRequest = am.requestImage("Apollo_15_flag,_rover,_LM,_Irwin.jpg");
 }
 
-MenuView::~MenuView() {
-      if (heroicImage) {
-          SDL_FreeSurface(heroicImage);
-      }
+bool MenuView::loading() const {
+    return heroicImageRequest.valid();
 }
 
 void MenuView::draw(SDL_Surface* screen) {
+    if (heroicImageRequest.valid() &&
+        heroicImageRequest.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        try {
+            heroicImage = heroicImageRequest.get();
+        } catch (const std::runtime_error& e) {
+            std::cout << "Could not load the menu background: " << e.what() << "\n";
+        }
+        heroicImageRequest = {};
+    }
+
     // Draw HEROIC background image
-    float aspectRatio = heroicImage->w / heroicImage->h;
-    SDL_Rect blitDestinationRect = SDL_Rect{0, 0, screen->w, int(screen->w/aspectRatio)};
-    blitDestinationRect.x = screen->w / 2 - blitDestinationRect.w / 2;
-    blitDestinationRect.y = screen->h / 2 - blitDestinationRect.h / 2;
-    SDL_BlitScaled(heroicImage, nullptr, screen, &blitDestinationRect);
+    SDL_FillRect(screen, nullptr, SDL_MapRGB(screen->format, 0, 0, 0));
+    if (heroicImage) {
+        float aspectRatio = float(heroicImage->w) / heroicImage->h;
+        SDL_Rect blitDestinationRect = SDL_Rect{0, 0, screen->w, int(screen->w/aspectRatio)};
+        blitDestinationRect.x = screen->w / 2 - blitDestinationRect.w / 2;
+        blitDestinationRect.y = screen->h / 2 - blitDestinationRect.h / 2;
+        SDL_BlitScaled(heroicImage.get(), nullptr, screen, &blitDestinationRect);
+    }
 
     // Draw the buttons
     startButton.draw(screen);
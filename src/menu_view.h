@@ -2,6 +2,8 @@
 #define MENU_VIEW_H_INCLUDED
 
 #include <SDL.h>
+#include <future>
+#include <memory>
 #include "view.h"
 #include "button_view.h"
 
@@ -9,16 +11,20 @@
 class MenuView : public View {
     public:
         MenuView(SDL_Surface* surf, int& currentView);
-        ~MenuView();
         void draw(SDL_Surface* screen);
         SDL_Rect boundary() const;
         void handleClicks(SDL_MouseButtonEvent& mouseButtonEvent);
         void handleResize(SDL_Surface* newSurface);
 
+        // True while the background image is still being decoded, so the
+        // menu should be redrawn once it arrives.
+        bool loading() const;
+
     private:
         ButtonView startButton;
         ButtonView quitButton;
-        SDL_Surface* heroicImage;
+        std::shared_future<std::shared_ptr<SDL_Surface>> heroicImageRequest;
+        std::shared_ptr<SDL_Surface> heroicImage;
 };
 
 
@@ -2,9 +2,11 @@
 #include "asset_manager.h"
 #include "SDL.h"
 
-MoonView::MoonView(SDL_Rect moonBoundary, int deltaX, int deltaY) {
+#include <utility>
+
+MoonView::MoonView(SDL_Rect moonBoundary, Grid terrain, int deltaX, int deltaY)
+    : moonGrid(std::move(terrain)), terrainPager(nullptr) {
     boundaryMoonView = moonBoundary;
-    moonGrid = Grid(300, 300, 6.0);
     camera = Basis();
 }
 
@@ -32,9 +34,17 @@ Grid& MoonView::getGrid() {
     return moonGrid;
 }
 
+void MoonView::setTerrainPager(const TerrainPager* pager) {
+    terrainPager = pager;
+}
+
 void MoonView::drawWithRenderer(const Renderer& r) const {
     // Viewport is filled with black.
     SDL_FillRect(r.getScreen(), &boundaryMoonView, SDL_MapRGB(r.getScreen()->format, 0, 0, 0));
 
-    moonGrid.render(r);
+    if (terrainPager != nullptr) {
+        terrainPager->render(r);
+    } else {
+        moonGrid.render(r);
+    }
 }
@@ -5,10 +5,12 @@
 #include "grid.h"
 #include "basis.h"
 #include "render.h"
+#include "terrain_pager.h"
 
 class MoonView : public View {
     public:
-        MoonView(SDL_Rect moonBoundary, int deltaX, int deltaY);
+        // The moon view takes ownership of the terrain it displays.
+        MoonView(SDL_Rect moonBoundary, Grid terrain, int deltaX, int deltaY);
 
         // This function no longer works, it just draws a black rectangle. If
         // you want to draw the moon, call drawWithRenderer().
@@ -20,6 +22,10 @@ class MoonView : public View {
         void setCamera(const Basis& newCamera);
         Grid& getGrid();
 
+        // When a pager is set, the moon view draws the pager's resident
+        // tiles instead of its own grid.  The pager must outlive the view.
+        void setTerrainPager(const TerrainPager* pager);
+
         // Allows the moon_view to draw using a renderer instead of an
         // SDL_Surface because our moon grid can no longer render with an
         // SDL_Surface.
@@ -28,6 +34,7 @@ class MoonView : public View {
     private:
         SDL_Rect boundaryMoonView;
         Grid moonGrid;
+        const TerrainPager* terrainPager;
         Basis camera;
 };
 
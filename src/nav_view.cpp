@@ -1,15 +1,43 @@
 #include "nav_view.h"
 #include "asset_manager.h"
+#include "texture_pyramid.h"
 #include "SDL.h"
 
-NavView::NavView(SDL_Rect navBoundary, int deltaX, int deltaY) {
+NavView::NavView(SDL_Rect navBoundary, int deltaX, int deltaY)
+    : map(nullptr), focusU(0.5), focusV(0.5) {
     boundaryNavView = navBoundary;
 }
 
 void NavView::draw(SDL_Surface* screen) {
-    SDL_FillRect(screen, &boundaryNavView, SDL_MapRGB(screen->format, 15, 181, 0));
+    if (map == nullptr) {
+        SDL_FillRect(screen, &boundaryNavView, SDL_MapRGB(screen->format, 15, 181, 0));
+        return;
+    }
+
+    // Show a quarter of the map's width, keeping the map's aspect ratio.
+    const double spanV = 0.25;
+    const double spanU = spanV * boundaryNavView.h / boundaryNavView.w * map->width() / map->height();
+    map->draw(screen, boundaryNavView,
+              focusU - spanU / 2, focusV - spanV / 2,
+              focusU + spanU / 2, focusV + spanV / 2);
+
+    // Mark where we are.
+    const int markerSize = 5;
+    SDL_Rect marker = {boundaryNavView.x + (boundaryNavView.w - markerSize) / 2,
+                       boundaryNavView.y + (boundaryNavView.h - markerSize) / 2,
+                       markerSize, markerSize};
+    SDL_FillRect(screen, &marker, SDL_MapRGB(screen->format, 15, 181, 0));
 }
 
 SDL_Rect NavView::boundary() const {
     return boundaryNavView;
 }
+
+void NavView::setMap(TextureTileCache* map) {
+    this->map = map;
+}
+
+void NavView::setFocus(double u, double v) {
+    focusU = u;
+    focusV = v;
+}
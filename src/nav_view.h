@@ -3,14 +3,26 @@
 
 #include "view.h"
 
+class TextureTileCache;
+
 class NavView : public View {
 	public:
         NavView(SDL_Rect navBoundary, int deltaX, int deltaY);
         void draw(SDL_Surface* screen);
         SDL_Rect boundary() const;
         // void handleResize(SDL_Surface* screen);
+
+        // Shows the area around the focus on the given map of the lunar
+        // surface, or a plain panel if map is null.
+        void setMap(TextureTileCache* map);
+
+        // Centers the map on a grid location, as returned by Grid::gridLocation().
+        void setFocus(double u, double v);
     private:
         SDL_Rect boundaryNavView;
+        TextureTileCache* map;
+        double focusU;
+        double focusV;
 };
 
 
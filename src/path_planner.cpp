@@ -0,0 +1,445 @@
+#include "path_planner.h"
+#include "grid.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+using namespace std;
+
+namespace {
+    const double infinity = numeric_limits<double>::infinity();
+
+    // Crossings in a run shorter than this get one entrance in the middle,
+    // and longer runs get one at each end.
+    const int longRun = 6;
+
+    // The cheapest possible cost between two lattice points: every step
+    // costs at least its length.
+    double octileDistance(const Grid& grid, uint32_t from, uint32_t to) {
+        const int columns = static_cast<int>(grid.columns()) + 1;
+        const int rowDistance = abs(static_cast<int>(from / columns) - static_cast<int>(to / columns));
+        const int columnDistance = abs(static_cast<int>(from % columns) - static_cast<int>(to % columns));
+        const int diagonal = min(rowDistance, columnDistance);
+        const int straight = max(rowDistance, columnDistance) - diagonal;
+        return grid.cellSize() * (straight + diagonal * sqrt(2.0));
+    }
+
+    // An entry in the open set of a search, cheapest first.
+    struct Open {
+        double priority;
+        uint32_t point;
+        bool operator<(const Open& other) const { return priority > other.priority; }
+    };
+}
+
+RoverCosts::RoverCosts() : maxSlopeDeg(25), slopeCost(2), climbCost(1) {}
+RoverCosts::RoverCosts(double maxSlopeDeg_, double slopeCost_, double climbCost_)
+    : maxSlopeDeg(maxSlopeDeg_), slopeCost(slopeCost_), climbCost(climbCost_) {}
+
+PathPlanner::PathPlanner(RoverCosts costs, int clusterSize)
+    : costs_(costs), clusterSize_(clusterSize), rows_(0), columns_(0), clusterRows_(0), clusterColumns_(0) {}
+
+void PathPlanner::build(const Grid& grid) {
+    rows_ = static_cast<int>(grid.rows()) + 1;
+    columns_ = static_cast<int>(grid.columns()) + 1;
+    clusterRows_ = (rows_ + clusterSize_ - 1) / clusterSize_;
+    clusterColumns_ = (columns_ + clusterSize_ - 1) / clusterSize_;
+    eastBorders_.assign(static_cast<size_t>(clusterRows_) * clusterColumns_, Border());
+    southBorders_.assign(static_cast<size_t>(clusterRows_) * clusterColumns_, Border());
+    graph_.clear();
+    rebuild(grid, 0, 0, clusterRows_ - 1, clusterColumns_ - 1);
+}
+
+void PathPlanner::update(const Grid& grid, const GridRegion& region) {
+    if (region.empty() || eastBorders_.empty()) {
+        return;
+    }
+
+    // A step's cost depends on the slopes at both of its ends, and a height
+    // edit changes the slopes of its neighbors too.
+    const int row0 = max(region.row0 - 2, 0);
+    const int column0 = max(region.column0 - 2, 0);
+    const int row1 = min(region.row1 + 2, rows_ - 1);
+    const int column1 = min(region.column1 + 2, columns_ - 1);
+    rebuild(grid, row0 / clusterSize_, column0 / clusterSize_, row1 / clusterSize_, column1 / clusterSize_);
+}
+
+uint32_t PathPlanner::pointAt(int row, int column) const {
+    return static_cast<uint32_t>(row) * columns_ + column;
+}
+
+double PathPlanner::stepCost(const Grid& grid, uint32_t from, uint32_t to) const {
+    const double* slopes = grid.slopes();
+    const double* heights = grid.heights();
+    const size_t fromIndex = grid.latticeIndex(from / columns_, from % columns_);
+    const size_t toIndex = grid.latticeIndex(to / columns_, to % columns_);
+    if (slopes[fromIndex] > costs_.maxSlopeDeg || slopes[toIndex] > costs_.maxSlopeDeg) {
+        return infinity;
+    }
+    const bool diagonal = from / columns_ != to / columns_ && from % columns_ != to % columns_;
+    const double length = grid.cellSize() * (diagonal ? sqrt(2.0) : 1.0);
+    const double slope = (slopes[fromIndex] + slopes[toIndex]) / 2;
+    return length * (1 + costs_.slopeCost * slope / costs_.maxSlopeDeg) +
+           costs_.climbCost * abs(heights[toIndex] - heights[fromIndex]);
+}
+
+GridRegion PathPlanner::clusterBounds(int clusterRow, int clusterColumn) const {
+    return GridRegion(clusterRow * clusterSize_, clusterColumn * clusterSize_,
+                      min((clusterRow + 1) * clusterSize_, rows_) - 1,
+                      min((clusterColumn + 1) * clusterSize_, columns_) - 1);
+}
+
+PathPlanner::Border PathPlanner::findCrossings(const Grid& grid, int clusterRow, int clusterColumn, bool east) const {
+    Border crossings;
+    const GridRegion bounds = clusterBounds(clusterRow, clusterColumn);
+    if ((east && bounds.column1 + 1 >= columns_) || (!east && bounds.row1 + 1 >= rows_)) {
+        return crossings;
+    }
+
+    // Walk along the edge, collecting runs of places where the rover can
+    // step straight across.
+    const int length = east ? bounds.row1 - bounds.row0 + 1 : bounds.column1 - bounds.column0 + 1;
+    auto crossing = [&] (int i) {
+        const int row = east ? bounds.row0 + i : bounds.row1;
+        const int column = east ? bounds.column1 : bounds.column0 + i;
+        const uint32_t inside = pointAt(row, column);
+        const uint32_t outside = east ? pointAt(row, column + 1) : pointAt(row + 1, column);
+        return make_pair(inside, outside);
+    };
+    int runStart = -1;
+    for (int i = 0; i <= length; i++) {
+        const bool open = i < length && stepCost(grid, crossing(i).first, crossing(i).second) < infinity;
+        if (open && runStart < 0) {
+            runStart = i;
+        } else if (!open && runStart >= 0) {
+            const int runEnd = i - 1;
+            if (runEnd - runStart + 1 < longRun) {
+                crossings.push_back(crossing((runStart + runEnd) / 2));
+            } else {
+                crossings.push_back(crossing(runStart));
+                crossings.push_back(crossing(runEnd));
+            }
+            runStart = -1;
+        }
+    }
+    return crossings;
+}
+
+vector<uint32_t> PathPlanner::entrances(int clusterRow, int clusterColumn) const {
+    vector<uint32_t> points;
+    auto border = [this] (const vector<Border>& borders, int row, int column) -> const Border* {
+        if (row < 0 || column < 0 || row >= clusterRows_ || column >= clusterColumns_) {
+            return nullptr;
+        }
+        return &borders[static_cast<size_t>(row) * clusterColumns_ + column];
+    };
+    for (const Border* own : {border(eastBorders_, clusterRow, clusterColumn),
+                              border(southBorders_, clusterRow, clusterColumn)}) {
+        if (own) {
+            for (const auto& crossing : *own) {
+                points.push_back(crossing.first);
+            }
+        }
+    }
+    for (const Border* neighbor : {border(eastBorders_, clusterRow, clusterColumn - 1),
+                                   border(southBorders_, clusterRow - 1, clusterColumn)}) {
+        if (neighbor) {
+            for (const auto& crossing : *neighbor) {
+                points.push_back(crossing.second);
+            }
+        }
+    }
+    sort(points.begin(), points.end());
+    points.erase(unique(points.begin(), points.end()), points.end());
+    return points;
+}
+
+void PathPlanner::rebuild(const Grid& grid, int clusterRow0, int clusterColumn0, int clusterRow1, int clusterColumn1) {
+    // Changing a cluster's crossings changes the entrances of its neighbors,
+    // so their cached routes have to be found again as well.
+    const int refitRow0 = max(clusterRow0 - 1, 0);
+    const int refitColumn0 = max(clusterColumn0 - 1, 0);
+    const int refitRow1 = min(clusterRow1 + 1, clusterRows_ - 1);
+    const int refitColumn1 = min(clusterColumn1 + 1, clusterColumns_ - 1);
+
+    auto eraseEdges = [this] (uint32_t point, auto shouldErase) {
+        auto found = graph_.find(point);
+        if (found != graph_.end()) {
+            vector<Edge>& edges = found->second;
+            edges.erase(remove_if(edges.begin(), edges.end(), shouldErase), edges.end());
+            if (edges.empty()) {
+                graph_.erase(found);
+            }
+        }
+    };
+
+    // Forget the old crossings of the changed clusters, and the old routes
+    // inside every cluster that is refitted.
+    for (int clusterRow = refitRow0; clusterRow <= refitRow1; clusterRow++) {
+        for (int clusterColumn = refitColumn0; clusterColumn <= refitColumn1; clusterColumn++) {
+            for (uint32_t point : entrances(clusterRow, clusterColumn)) {
+                eraseEdges(point, [] (const Edge& edge) { return edge.inside; });
+            }
+        }
+    }
+    vector<pair<int, int>> changedEast, changedSouth;
+    for (int clusterRow = clusterRow0; clusterRow <= clusterRow1; clusterRow++) {
+        for (int clusterColumn = max(clusterColumn0 - 1, 0); clusterColumn <= clusterColumn1; clusterColumn++) {
+            changedEast.emplace_back(clusterRow, clusterColumn);
+        }
+    }
+    for (int clusterRow = max(clusterRow0 - 1, 0); clusterRow <= clusterRow1; clusterRow++) {
+        for (int clusterColumn = clusterColumn0; clusterColumn <= clusterColumn1; clusterColumn++) {
+            changedSouth.emplace_back(clusterRow, clusterColumn);
+        }
+    }
+    for (bool east : {true, false}) {
+        vector<Border>& borders = east ? eastBorders_ : southBorders_;
+        for (const auto& [clusterRow, clusterColumn] : east ? changedEast : changedSouth) {
+            Border& border = borders[static_cast<size_t>(clusterRow) * clusterColumns_ + clusterColumn];
+            for (const auto& [inside, outside] : border) {
+                const uint32_t a = inside, b = outside;
+                eraseEdges(a, [b] (const Edge& edge) { return !edge.inside && edge.to == b; });
+                eraseEdges(b, [a] (const Edge& edge) { return !edge.inside && edge.to == a; });
+            }
+            border = findCrossings(grid, clusterRow, clusterColumn, east);
+            for (const auto& [inside, outside] : border) {
+                const double cost = stepCost(grid, inside, outside);
+                graph_[inside].push_back(Edge{outside, cost, false});
+                graph_[outside].push_back(Edge{inside, cost, false});
+            }
+        }
+    }
+
+    // Find the routes between the entrances of each refitted cluster.  The
+    // clusters are independent, so they are searched in parallel and merged
+    // into the graph afterwards.
+    const int refitColumns = refitColumn1 - refitColumn0 + 1;
+    const int refitCount = (refitRow1 - refitRow0 + 1) * refitColumns;
+    vector<vector<tuple<uint32_t, uint32_t, double>>> routes(refitCount);
+    getThreadPool().parallelFor(0, refitCount, [&] (int first, int last) {
+        vector<double> cost;
+        vector<int> parent;
+        for (int refit = first; refit < last; refit++) {
+            const int clusterRow = refitRow0 + refit / refitColumns;
+            const int clusterColumn = refitColumn0 + refit % refitColumns;
+            const GridRegion bounds = clusterBounds(clusterRow, clusterColumn);
+            const int width = bounds.column1 - bounds.column0 + 1;
+            const vector<uint32_t> points = entrances(clusterRow, clusterColumn);
+            for (uint32_t from : points) {
+                searchWithin(grid, bounds, from, -1, cost, parent);
+                for (uint32_t to : points) {
+                    const int row = to / columns_ - bounds.row0;
+                    const int column = to % columns_ - bounds.column0;
+                    const double routeCost = cost[row * width + column];
+                    if (to != from && routeCost < infinity) {
+                        routes[refit].emplace_back(from, to, routeCost);
+                    }
+                }
+            }
+        }
+    });
+    for (const auto& clusterRoutes : routes) {
+        for (const auto& [from, to, cost] : clusterRoutes) {
+            graph_[from].push_back(Edge{to, cost, true});
+        }
+    }
+}
+
+void PathPlanner::searchWithin(const Grid& grid, const GridRegion& bounds, uint32_t start, int64_t goal,
+                               vector<double>& cost, vector<int>& parent) const {
+    const int width = bounds.column1 - bounds.column0 + 1;
+    const int height = bounds.row1 - bounds.row0 + 1;
+    cost.assign(static_cast<size_t>(width) * height, infinity);
+    parent.assign(static_cast<size_t>(width) * height, -1);
+    auto local = [this, &bounds, width] (uint32_t point) {
+        return (static_cast<int>(point / columns_) - bounds.row0) * width + static_cast<int>(point % columns_) - bounds.column0;
+    };
+    auto estimate = [&grid, goal] (uint32_t point) {
+        return goal < 0 ? 0.0 : octileDistance(grid, point, static_cast<uint32_t>(goal));
+    };
+
+    priority_queue<Open> open;
+    cost[local(start)] = 0;
+    open.push(Open{estimate(start), start});
+    while (!open.empty()) {
+        const Open next = open.top();
+        open.pop();
+        const uint32_t point = next.point;
+        const double pointCost = cost[local(point)];
+        if (next.priority > pointCost + estimate(point)) {
+            continue;   // A stale entry for a point reached more cheaply since
+        }
+        if (static_cast<int64_t>(point) == goal) {
+            return;
+        }
+        const int row = point / columns_;
+        const int column = point % columns_;
+        for (int rowStep = -1; rowStep <= 1; rowStep++) {
+            for (int columnStep = -1; columnStep <= 1; columnStep++) {
+                const int neighborRow = row + rowStep;
+                const int neighborColumn = column + columnStep;
+                if ((rowStep == 0 && columnStep == 0) ||
+                    neighborRow < bounds.row0 || neighborRow > bounds.row1 ||
+                    neighborColumn < bounds.column0 || neighborColumn > bounds.column1) {
+                    continue;
+                }
+                const uint32_t neighbor = pointAt(neighborRow, neighborColumn);
+                const double neighborCost = pointCost + stepCost(grid, point, neighbor);
+                if (neighborCost < cost[local(neighbor)]) {
+                    cost[local(neighbor)] = neighborCost;
+                    parent[local(neighbor)] = local(point);
+                    open.push(Open{neighborCost + estimate(neighbor), neighbor});
+                }
+            }
+        }
+    }
+}
+
+vector<uint32_t> PathPlanner::pathWithin(const Grid& grid, const GridRegion& bounds,
+                                         uint32_t start, uint32_t goal) const {
+    vector<double> cost;
+    vector<int> parent;
+    searchWithin(grid, bounds, start, goal, cost, parent);
+    const int width = bounds.column1 - bounds.column0 + 1;
+    int at = (static_cast<int>(goal / columns_) - bounds.row0) * width + static_cast<int>(goal % columns_) - bounds.column0;
+    if (cost[at] == infinity) {
+        return vector<uint32_t>();
+    }
+    vector<uint32_t> path;
+    for (; at >= 0; at = parent[at]) {
+        path.push_back(pointAt(bounds.row0 + at / width, bounds.column0 + at % width));
+    }
+    reverse(path.begin(), path.end());
+    return path;
+}
+
+vector<pair<int, int>> PathPlanner::findPath(const Grid& grid, int startRow, int startColumn,
+                                             int goalRow, int goalColumn) const {
+    for (const auto& [row, column] : {make_pair(startRow, startColumn), make_pair(goalRow, goalColumn)}) {
+        if (row < 0 || row >= rows_ || column < 0 || column >= columns_) {
+            throw runtime_error("(" + to_string(row) + ", " + to_string(column) + ") is outside the grid");
+        }
+    }
+    const uint32_t start = pointAt(startRow, startColumn);
+    const uint32_t goal = pointAt(goalRow, goalColumn);
+    const GridRegion startBounds = clusterBounds(startRow / clusterSize_, startColumn / clusterSize_);
+    const GridRegion goalBounds = clusterBounds(goalRow / clusterSize_, goalColumn / clusterSize_);
+    auto cluster = [this] (uint32_t point) {
+        return make_pair(static_cast<int>(point / columns_) / clusterSize_,
+                         static_cast<int>(point % columns_) / clusterSize_);
+    };
+
+    // Prefer a route that stays inside the cluster when both ends share one.
+    vector<uint32_t> route;
+    if (cluster(start) == cluster(goal)) {
+        route = pathWithin(grid, startBounds, start, goal);
+    }
+
+    if (route.empty()) {
+        // Join the start and the goal to the entrances of their clusters.
+        vector<double> cost;
+        vector<int> parent;
+        auto costsToEntrances = [&] (uint32_t point, const GridRegion& bounds) {
+            unordered_map<uint32_t, double> costs;
+            searchWithin(grid, bounds, point, -1, cost, parent);
+            const int width = bounds.column1 - bounds.column0 + 1;
+            const auto [clusterRow, clusterColumn] = cluster(point);
+            for (uint32_t entrance : entrances(clusterRow, clusterColumn)) {
+                const int row = entrance / columns_ - bounds.row0;
+                const int column = entrance % columns_ - bounds.column0;
+                if (cost[row * width + column] < infinity) {
+                    costs[entrance] = cost[row * width + column];
+                }
+            }
+            return costs;
+        };
+        const unordered_map<uint32_t, double> fromStart = costsToEntrances(start, startBounds);
+        const unordered_map<uint32_t, double> toGoal = costsToEntrances(goal, goalBounds);
+
+        // A* over the entrances.  The goal is reached through whichever
+        // entrance of its cluster gets it there cheapest.
+        const uint32_t goalNode = numeric_limits<uint32_t>::max();
+        unordered_map<uint32_t, double> best;
+        unordered_map<uint32_t, uint32_t> cameFrom;
+        priority_queue<Open> open;
+        for (const auto& [entrance, entranceCost] : fromStart) {
+            best[entrance] = entranceCost;
+            cameFrom[entrance] = start;
+            open.push(Open{entranceCost + octileDistance(grid, entrance, goal), entrance});
+        }
+        bool found = false;
+        while (!open.empty()) {
+            const Open next = open.top();
+            open.pop();
+            if (next.point == goalNode) {
+                found = true;
+                break;
+            }
+            const double nodeCost = best[next.point];
+            if (next.priority > nodeCost + octileDistance(grid, next.point, goal)) {
+                continue;
+            }
+            auto exit = toGoal.find(next.point);
+            if (exit != toGoal.end()) {
+                auto goalCost = best.find(goalNode);
+                if (goalCost == best.end() || nodeCost + exit->second < goalCost->second) {
+                    best[goalNode] = nodeCost + exit->second;
+                    cameFrom[goalNode] = next.point;
+                    open.push(Open{nodeCost + exit->second, goalNode});
+                }
+            }
+            auto edges = graph_.find(next.point);
+            if (edges == graph_.end()) {
+                continue;
+            }
+            for (const Edge& edge : edges->second) {
+                const double edgeCost = nodeCost + edge.cost;
+                auto known = best.find(edge.to);
+                if (known == best.end() || edgeCost < known->second) {
+                    best[edge.to] = edgeCost;
+                    cameFrom[edge.to] = next.point;
+                    open.push(Open{edgeCost + octileDistance(grid, edge.to, goal), edge.to});
+                }
+            }
+        }
+        if (!found) {
+            return vector<pair<int, int>>();
+        }
+
+        // Fill in the steps between consecutive entrances.  Entrances in
+        // different clusters are neighbors across a border.
+        vector<uint32_t> waypoints = {goal};
+        for (uint32_t at = cameFrom[goalNode]; at != start; at = cameFrom[at]) {
+            waypoints.push_back(at);
+        }
+        waypoints.push_back(start);
+        reverse(waypoints.begin(), waypoints.end());
+
+        route.push_back(start);
+        for (size_t i = 1; i < waypoints.size(); i++) {
+            const uint32_t from = waypoints[i - 1];
+            const uint32_t to = waypoints[i];
+            if (cluster(from) != cluster(to)) {
+                route.push_back(to);
+                continue;
+            }
+            const auto [clusterRow, clusterColumn] = cluster(from);
+            const vector<uint32_t> leg = pathWithin(grid, clusterBounds(clusterRow, clusterColumn), from, to);
+            route.insert(route.end(), leg.begin() + 1, leg.end());
+        }
+    }
+
+    vector<pair<int, int>> path;
+    path.reserve(route.size());
+    for (uint32_t point : route) {
+        path.emplace_back(point / columns_, point % columns_);
+    }
+    return path;
+}
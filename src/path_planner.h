@@ -0,0 +1,102 @@
+#ifndef PATH_PLANNER_H_INCLUDED
+#define PATH_PLANNER_H_INCLUDED
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Grid;
+struct GridRegion;
+
+// What it costs a rover to drive between neighboring lattice points.
+//
+// A step costs its length, plus slopeCost times its length for every
+// maxSlopeDeg of slope at its ends, plus climbCost for every unit of height
+// it climbs or descends.  Lattice points steeper than maxSlopeDeg can't be
+// driven over at all.
+struct RoverCosts {
+    double maxSlopeDeg;
+    double slopeCost;
+    double climbCost;
+
+    RoverCosts();
+    RoverCosts(double maxSlopeDeg_, double slopeCost_, double climbCost_);
+};
+
+// Plans rover routes over a grid's lattice with HPA*.
+//
+// The lattice is cut into square clusters.  Wherever a rover can cross from
+// one cluster into the next, the crossing becomes an entrance, and the
+// cheapest routes between the entrances of each cluster are found once and
+// cached.  A query then only searches the small graph of entrances, and fills
+// in the steps between them cluster by cluster.  Routes come out close to,
+// but not always exactly, the cheapest.
+class PathPlanner {
+    public:
+        PathPlanner(RoverCosts costs = RoverCosts(), int clusterSize = 32);
+
+        // Finds the entrances of every cluster.  This must be called whenever
+        // the grid's dimensions change.
+        void build(const Grid& grid);
+
+        // Re-abstracts only the clusters around the given lattice points,
+        // after their heights or slopes changed.
+        void update(const Grid& grid, const GridRegion& region);
+
+        // The lattice points, as (row, column), of a route from the start to
+        // the goal, including both.  Returns an empty route if there is none.
+        //
+        // Throws std::runtime_error if either point is outside the grid.
+        std::vector<std::pair<int, int>> findPath(const Grid& grid, int startRow, int startColumn,
+                                                  int goalRow, int goalColumn) const;
+
+    private:
+        struct Edge {
+            std::uint32_t to;            // The other entrance
+            double cost;
+            bool inside;                 // Between entrances of the same cluster
+        };
+        typedef std::vector<std::pair<std::uint32_t, std::uint32_t>> Border;
+
+        RoverCosts costs_;
+        int clusterSize_;
+        int rows_, columns_;             // Lattice points
+        int clusterRows_, clusterColumns_;
+
+        // The crossings out of each cluster through its right and bottom
+        // edges, as (inside, outside) points, cluster by cluster.
+        std::vector<Border> eastBorders_;
+        std::vector<Border> southBorders_;
+
+        // The abstract graph, keyed by entrance.
+        std::unordered_map<std::uint32_t, std::vector<Edge>> graph_;
+
+        // Lattice points are numbered row by row, whatever the grid's
+        // lattice layout, so that rows and columns are cheap to recover.
+        std::uint32_t pointAt(int row, int column) const;
+
+        // The cost of a step between neighboring lattice points, or infinity
+        // if the rover can't make it.
+        double stepCost(const Grid& grid, std::uint32_t from, std::uint32_t to) const;
+
+        // Re-abstracts a rectangle of clusters.
+        void rebuild(const Grid& grid, int clusterRow0, int clusterColumn0, int clusterRow1, int clusterColumn1);
+        Border findCrossings(const Grid& grid, int clusterRow, int clusterColumn, bool east) const;
+        std::vector<std::uint32_t> entrances(int clusterRow, int clusterColumn) const;
+        GridRegion clusterBounds(int clusterRow, int clusterColumn) const;
+
+        // Searches the lattice points inside bounds outwards from start, for
+        // the goal if there is one (A*) or for all of them if goal is
+        // negative (Dijkstra).  Fills in each point's cost from start and
+        // the point it was reached from, indexed row by row within bounds.
+        void searchWithin(const Grid& grid, const GridRegion& bounds, std::uint32_t start, std::int64_t goal,
+                          std::vector<double>& cost, std::vector<int>& parent) const;
+
+        // The cheapest route from start to goal inside bounds, as points,
+        // or an empty route if there is none.
+        std::vector<std::uint32_t> pathWithin(const Grid& grid, const GridRegion& bounds,
+                                              std::uint32_t start, std::uint32_t goal) const;
+};
+
+#endif // PATH_PLANNER_H_INCLUDED
@@ -0,0 +1,43 @@
+// Converts a huge image, such as the lunar surface texture, into a tiled mip
+// pyramid that the program can draw from without loading the whole image.
+//
+// Usage: altitution-pyramid <image> <pyramid> [tile size]
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "SDL.h"
+#include "SDL_image.h"
+#include "texture_pyramid.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 4) {
+        cerr << "Usage: " << argv[0] << " <image> <pyramid> [tile size]\n";
+        return 1;
+    }
+    const int tileSize = argc == 4 ? atoi(argv[3]) : 256;
+
+    int flags = IMG_INIT_JPG | IMG_INIT_PNG;
+    if ((IMG_Init(flags) & flags) != flags) {
+        cerr << "IMG_Init: " << IMG_GetError() << "\n";
+        return 1;
+    }
+
+    int result = 0;
+    try {
+        cout << "Converting " << argv[1] << " into " << argv[2] << "...\n";
+        buildTexturePyramid(argv[1], argv[2], tileSize);
+        cout << "Done.\n";
+    } catch (const std::runtime_error& e) {
+        cerr << "Could not convert " << argv[1] << ": " << e.what() << "\n";
+        result = 1;
+    }
+
+    IMG_Quit();
+    SDL_Quit();
+    return result;
+}
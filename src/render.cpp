@@ -1,12 +1,29 @@
 #include "render.h"
 
+#include "thread_pool.h"
+
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <limits>
 
 using namespace std;
 
+namespace {
+    // The side of the square screen tiles that are rasterized in parallel.
+    const int rasterTileSize = 64;
+
+    // How many triangles each task transforms and sets up.
+    const int trianglesPerBlock = 4096;
+
+    // Screen coordinates are snapped to 1 / subpixels of a pixel.
+    const int subpixelBits = 4;
+    const int64_t subpixels = int64_t(1) << subpixelBits;
+}
+
 Renderer::Renderer() : canvas(nullptr), viewPortRect(SDL_Rect{0, 0, 0, 0}), camera(), cameraMatrix(),
-                       screenRect(SDL_Rect{0, 0, 0, 0}), projectionMatrix(), pixels(nullptr) {}
+                       screenRect(SDL_Rect{0, 0, 0, 0}), projectionMatrix(), screenMatrix(), pixels(nullptr),
+                       style(RenderStyle::Filled), depthBuffer(make_shared<vector<float>>()) {}
 
 void Renderer::prepare(SDL_Surface* canvas, SDL_Renderer* sdlRenderer, SDL_Rect viewPortRect, Basis camera) {
     this->canvas = canvas;
@@ -28,8 +45,10 @@ void Renderer::prepare(SDL_Surface* canvas, SDL_Renderer* sdlRenderer, SDL_Rect
     };
 
     projectionMatrix = ::projectionMatrix(focalDistance, screenRect, viewPortRect);
+    screenMatrix = projectionMatrix * cameraMatrix;
 
     pixels = static_cast<uint32_t*>(canvas->pixels);
+    depthBuffer->assign(static_cast<size_t>(canvas->w) * canvas->h, numeric_limits<float>::infinity());
 }
 
 SDL_Surface* Renderer::getScreen() const{
@@ -40,6 +59,337 @@ Basis Renderer::getCamera() const{
     return camera;
 }
 
+RenderStyle Renderer::getStyle() const {
+    return style;
+}
+
+void Renderer::setStyle(RenderStyle style) {
+    this->style = style;
+}
+
+double Renderer::pixelsPerUnit(double depth) const {
+    // This is the horizontal scale of projectionMatrix() after the perspective divide.
+    return double(viewPortRect.w) / screenRect.w / (depth / focalDistance + 1);
+}
+
+Renderer Renderer::withModel(const Matrix& modelToWorld, const Matrix& worldToModel) const {
+    Renderer model = *this;
+    model.cameraMatrix = cameraMatrix * modelToWorld;
+    model.screenMatrix = projectionMatrix * model.cameraMatrix;
+    model.camera.apply(worldToModel);
+    return model;
+}
+
+void Renderer::renderTriangles(const Point* vertices, const SDL_Color* colors,
+                               const vector<uint32_t>& indices) const {
+    const Plane nearClipPlane = Plane(0, 0, 1, 0); // z = 0
+    // The bottom and right planes sit one pixel in, so that points clipped
+    // onto them still land on a pixel inside the viewport.
+    const Plane viewPortClipPlanes[] = {
+        Plane(0, 1, 0, -viewPortRect.y),                      // y = viewPortRect.y (top)
+        Plane(1, 0, 0, -viewPortRect.x),                      // x = viewPortRect.x (left)
+        Plane(0, -1, 0, viewPortRect.y + viewPortRect.h - 1), // -y = -viewPortRect.y - viewPortRect.h + 1 (bottom)
+        Plane(-1, 0, 0, viewPortRect.x + viewPortRect.w - 1), // -x = -viewPortRect.x - viewPortRect.w + 1 (right)
+    };
+    auto insideViewPort = [this] (const Point& p) {
+        return p.x >= viewPortRect.x && p.y >= viewPortRect.y &&
+               p.x < viewPortRect.x + viewPortRect.w && p.y < viewPortRect.y + viewPortRect.h;
+    };
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        Vertex corners[3];
+        bool inFront = true;
+        for (int k = 0; k < 3; k++) {
+            static_cast<Point&>(corners[k]) = cameraMatrix * vertices[indices[i + k]];
+            corners[k].color = colors[indices[i + k]];
+            inFront = inFront && corners[k].z > 0;
+        }
+
+        // Most triangles are entirely on screen, and need no clipping.
+        if (inFront) {
+            bool onScreen = true;
+            Vertex projected[3];
+            for (int k = 0; k < 3; k++) {
+                static_cast<Point&>(projected[k]) = projectionMatrix * corners[k];
+                projected[k].color = corners[k].color;
+                onScreen = onScreen && insideViewPort(projected[k]);
+            }
+            if (onScreen) {
+                for (int k = 0; k < 3; k++) {
+                    const Vertex& from = projected[k];
+                    const Vertex& to = projected[(k + 1) % 3];
+                    drawLine(from.x, from.y, to.x, to.y, from.color);
+                }
+                continue;
+            }
+        }
+
+        // The rest are clipped against the near plane in camera space, then
+        // against the edges of the viewport in screen space.
+        Polygon poly;
+        poly.vertices.assign(corners, corners + 3);
+        auto clipPoly = poly.clip(nearClipPlane);
+        if (clipPoly == nullopt) {
+            continue;
+        }
+        for (Vertex& v : clipPoly->vertices) {
+            static_cast<Point&>(v) = projectionMatrix * v;
+        }
+        bool clippedAway = false;
+        for (const Plane& viewPortClipPlane : viewPortClipPlanes) {
+            clipPoly = clipPoly->clip(viewPortClipPlane);
+            if (clipPoly == nullopt) {
+                clippedAway = true;
+                break;
+            }
+        }
+        if (clippedAway) {
+            continue;
+        }
+        const vector<Vertex>& clipped = clipPoly->vertices;
+        for (size_t k = 0; k < clipped.size(); k++) {
+            const Vertex& from = clipped[k];
+            const Vertex& to = clipped[(k + 1) % clipped.size()];
+            drawLine(from.x, from.y, to.x, to.y, from.color);
+        }
+    }
+}
+
+void Renderer::renderFilledTriangles(const Point* vertices, const SDL_Color* colors,
+                                     const vector<uint32_t>& indices) const {
+    const Plane nearClipPlane = Plane(0, 0, 1, 0); // z = 0
+    ThreadPool& pool = getThreadPool();
+
+    // A triangle's normal in camera space, the cross product of its edges
+    // there, is also the cofactor matrix of cameraMatrix's linear part times
+    // the cross product of its edges in model space.  These are that
+    // matrix's columns, so shading needs no corners in camera space.
+    const Vector axisX = cameraMatrix * Vector(1, 0, 0);
+    const Vector axisY = cameraMatrix * Vector(0, 1, 0);
+    const Vector axisZ = cameraMatrix * Vector(0, 0, 1);
+    const Vector normalX = crossProduct(axisY, axisZ);
+    const Vector normalY = crossProduct(axisZ, axisX);
+    const Vector normalZ = crossProduct(axisX, axisY);
+
+    // Project, clip, shade and set up the triangles, a block at a time.
+    // Each block keeps its own list, so that the triangles stay in order.
+    const int triangleCount = static_cast<int>(indices.size() / 3);
+    const int blockCount = (triangleCount + trianglesPerBlock - 1) / trianglesPerBlock;
+    vector<vector<RasterTriangle>> blocks(blockCount);
+    pool.parallelFor(0, blockCount, [&] (int firstBlock, int lastBlock) {
+        vector<Point> model(3 * trianglesPerBlock);
+        vector<Point> screen(3 * trianglesPerBlock);
+        vector<uint8_t> inFront(3 * trianglesPerBlock);
+        for (int block = firstBlock; block < lastBlock; block++) {
+            vector<RasterTriangle>& setUp = blocks[block];
+            const size_t first = static_cast<size_t>(block) * trianglesPerBlock;
+            const size_t last = min<size_t>(first + trianglesPerBlock, triangleCount);
+
+            // Every corner is projected in one batch, then the triangles are
+            // read back from the batch.
+            const size_t cornerCount = 3 * (last - first);
+            for (size_t k = 0; k < cornerCount; k++) {
+                model[k] = vertices[indices[3 * first + k]];
+            }
+            projectPoints(screenMatrix, model.data(), cornerCount, screen.data(), inFront.data());
+
+            for (size_t triangle = first; triangle < last; triangle++) {
+                const size_t i = 3 * triangle;
+                const size_t c = i - 3 * first;
+                const int front = inFront[c] + inFront[c + 1] + inFront[c + 2];
+                if (front == 0) {
+                    continue;
+                }
+
+                const Vector edges = crossProduct(model[c + 1] - model[c], model[c + 2] - model[c]);
+                const Vector normal = edges.x * normalX + edges.y * normalY + edges.z * normalZ;
+                const double length = normal.magnitude();
+                if (length == 0) {
+                    continue;
+                }
+                const double light = 0.25 + 0.75 * abs(normal.z) / length;
+                int red = 0, green = 0, blue = 0;
+                for (int k = 0; k < 3; k++) {
+                    const SDL_Color& color = colors[indices[i + k]];
+                    red += color.r;
+                    green += color.g;
+                    blue += color.b;
+                }
+                const uint32_t color = SDL_MapRGBA(canvas->format, static_cast<Uint8>(red * light / 3),
+                                                   static_cast<Uint8>(green * light / 3),
+                                                   static_cast<Uint8>(blue * light / 3), 255);
+
+                RasterTriangle raster;
+                if (front == 3) {
+                    if (setUpTriangle(screen[c], screen[c + 1], screen[c + 2], color, raster)) {
+                        setUp.push_back(raster);
+                    }
+                    continue;
+                }
+
+                // Triangles crossing the near plane are clipped in camera
+                // space, then drawn as a fan.
+                Polygon poly;
+                for (int k = 0; k < 3; k++) {
+                    Vertex v;
+                    static_cast<Point&>(v) = cameraMatrix * model[c + k];
+                    poly.vertices.push_back(v);
+                }
+                auto clipPoly = poly.clip(nearClipPlane);
+                if (clipPoly == nullopt) {
+                    continue;
+                }
+                vector<Point> projected;
+                for (const Vertex& v : clipPoly->vertices) {
+                    projected.push_back(projectionMatrix * v);
+                }
+                for (size_t k = 1; k + 1 < projected.size(); k++) {
+                    if (setUpTriangle(projected[0], projected[k], projected[k + 1], color, raster)) {
+                        setUp.push_back(raster);
+                    }
+                }
+            }
+        }
+    });
+
+    // Bin the triangles into the screen tiles that their bounds overlap.
+    const int tilesAcross = (viewPortRect.w + rasterTileSize - 1) / rasterTileSize;
+    const int tilesDown = (viewPortRect.h + rasterTileSize - 1) / rasterTileSize;
+    const int tileCount = tilesAcross * tilesDown;
+    vector<vector<const RasterTriangle*>> bins(tileCount);
+    for (const vector<RasterTriangle>& block : blocks) {
+        for (const RasterTriangle& triangle : block) {
+            const int tileX0 = (triangle.minX - viewPortRect.x) / rasterTileSize;
+            const int tileX1 = (triangle.maxX - viewPortRect.x) / rasterTileSize;
+            const int tileY0 = (triangle.minY - viewPortRect.y) / rasterTileSize;
+            const int tileY1 = (triangle.maxY - viewPortRect.y) / rasterTileSize;
+            for (int tileY = tileY0; tileY <= tileY1; tileY++) {
+                for (int tileX = tileX0; tileX <= tileX1; tileX++) {
+                    bins[tileY * tilesAcross + tileX].push_back(&triangle);
+                }
+            }
+        }
+    }
+
+    // Tiles cover separate pixels, so threads can rasterize them into the
+    // shared buffers without locking.  Busy tiles take much longer than
+    // empty ones, so threads take the next tile as they finish instead of
+    // being handed a fixed band of them.
+    atomic<int> nextTile(0);
+    pool.parallelFor(0, static_cast<int>(pool.size()), [&] (int, int) {
+        for (int tile = nextTile++; tile < tileCount; tile = nextTile++) {
+            const int x0 = viewPortRect.x + (tile % tilesAcross) * rasterTileSize;
+            const int y0 = viewPortRect.y + (tile / tilesAcross) * rasterTileSize;
+            const int x1 = min(x0 + rasterTileSize, viewPortRect.x + viewPortRect.w) - 1;
+            const int y1 = min(y0 + rasterTileSize, viewPortRect.y + viewPortRect.h) - 1;
+            for (const RasterTriangle* triangle : bins[tile]) {
+                rasterize(*triangle, x0, y0, x1, y1);
+            }
+        }
+    });
+}
+
+bool Renderer::setUpTriangle(const Point& a, const Point& b, const Point& c, uint32_t color,
+                             RasterTriangle& triangle) const {
+    // Corners are snapped to 1/16 of a pixel, so that the edge functions are
+    // exact and neighboring triangles agree on every pixel they share.
+    const double limit = 1 << 24;
+    const Point* corners[3] = {&a, &b, &c};
+    for (int k = 0; k < 3; k++) {
+        if (!(abs(corners[k]->x) < limit && abs(corners[k]->y) < limit)) {
+            return false;
+        }
+        triangle.x[k] = llround(corners[k]->x * subpixels);
+        triangle.y[k] = llround(corners[k]->y * subpixels);
+        triangle.z[k] = corners[k]->z;
+    }
+    int64_t* x = triangle.x;
+    int64_t* y = triangle.y;
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0) {
+        return false;
+    }
+    if (area < 0) {
+        swap(x[1], x[2]);
+        swap(y[1], y[2]);
+        swap(triangle.z[1], triangle.z[2]);
+        area = -area;
+    }
+    triangle.inverseArea = 1.0 / area;
+    triangle.color = color;
+
+    triangle.minX = static_cast<int>(max<int64_t>(viewPortRect.x, *min_element(x, x + 3) >> subpixelBits));
+    triangle.maxX = static_cast<int>(min<int64_t>(viewPortRect.x + viewPortRect.w - 1,
+                                                  (*max_element(x, x + 3) + subpixels - 1) >> subpixelBits));
+    triangle.minY = static_cast<int>(max<int64_t>(viewPortRect.y, *min_element(y, y + 3) >> subpixelBits));
+    triangle.maxY = static_cast<int>(min<int64_t>(viewPortRect.y + viewPortRect.h - 1,
+                                                  (*max_element(y, y + 3) + subpixels - 1) >> subpixelBits));
+    return triangle.minX <= triangle.maxX && triangle.minY <= triangle.maxY;
+}
+
+void Renderer::rasterize(const RasterTriangle& triangle, int clipX0, int clipY0, int clipX1, int clipY1) const {
+    const int64_t minX = max(triangle.minX, clipX0);
+    const int64_t maxX = min(triangle.maxX, clipX1);
+    const int64_t minY = max(triangle.minY, clipY0);
+    const int64_t maxY = min(triangle.maxY, clipY1);
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+    const int64_t* x = triangle.x;
+    const int64_t* y = triangle.y;
+    const double* z = triangle.z;
+
+    // Edge k is the one opposite corner k, and is positive inside the
+    // triangle.  Its function steps by stepX and stepY from one pixel center
+    // to the next.  Pixel centers that fall exactly on an edge belong to the
+    // triangle only if the edge is a top or left edge, so shared edges are
+    // filled exactly once.
+    const int from[3] = {1, 2, 0};
+    const int to[3] = {2, 0, 1};
+    int64_t rowEdge[3], stepX[3], stepY[3], bias[3];
+    const int64_t centerX = minX * subpixels + subpixels / 2;
+    const int64_t centerY = minY * subpixels + subpixels / 2;
+    for (int k = 0; k < 3; k++) {
+        const int64_t dx = x[to[k]] - x[from[k]];
+        const int64_t dy = y[to[k]] - y[from[k]];
+        rowEdge[k] = dx * (centerY - y[from[k]]) - dy * (centerX - x[from[k]]);
+        stepX[k] = -dy * subpixels;
+        stepY[k] = dx * subpixels;
+        const bool topLeft = dy < 0 || (dy == 0 && dx > 0);
+        bias[k] = topLeft ? 0 : -1;
+    }
+
+    // Depth is linear in screen space, so it steps like the edges do.
+    auto depthAt = [&] (const int64_t* edges) {
+        return (edges[0] * z[0] + edges[1] * z[1] + edges[2] * z[2]) * triangle.inverseArea;
+    };
+    const double depthStepX = depthAt(stepX);
+
+    float* depth = depthBuffer->data();
+    for (int64_t py = minY; py <= maxY; py++) {
+        int64_t e0 = rowEdge[0] + bias[0], e1 = rowEdge[1] + bias[1], e2 = rowEdge[2] + bias[2];
+        double rowDepth = depthAt(rowEdge);
+        const size_t rowOffset = static_cast<size_t>(py) * canvas->w;
+        for (int64_t px = minX; px <= maxX; px++) {
+            if ((e0 | e1 | e2) >= 0) {
+                const size_t offset = rowOffset + px;
+                const float pixelDepth = static_cast<float>(rowDepth);
+                if (pixelDepth < depth[offset]) {
+                    depth[offset] = pixelDepth;
+                    pixels[offset] = triangle.color;
+                }
+            }
+            e0 += stepX[0];
+            e1 += stepX[1];
+            e2 += stepX[2];
+            rowDepth += depthStepX;
+        }
+        for (int k = 0; k < 3; k++) {
+            rowEdge[k] += stepY[k];
+        }
+    }
+}
+
 void Renderer::drawLine(double x1, double y1, double x2, double y2, SDL_Color color) const {
     double x = x1;
     double y = y1;
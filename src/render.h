@@ -7,16 +7,28 @@
 #include "polygon.h"
 #include "common.h"
 
+#include <cstdint>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 
 
+// How meshes such as grids are drawn.
+enum class RenderStyle {
+    Filled,     // Shaded triangles, with hidden surfaces removed
+    Wireframe,  // The edges of every triangle
+    Points      // Only the corners of the triangles
+};
+
 // Makes sure that all of the drawing of the program happens in one spot.
 //
 // During each frame you must:
 //  - Call prepare in order to calculate frame-invariant data
 //  - Call renderPoint or renderPolygon
+//
+// A renderer can be reused from frame to frame, which saves reallocating
+// its depth buffer.
 class Renderer {
     public:
         Renderer();
@@ -30,38 +42,59 @@ class Renderer {
         // The camera is not exposed in the render so we can get it here.
         Basis getCamera() const;
 
+        // The style stays the same from frame to frame until it is changed.
+        RenderStyle getStyle() const;
+        void setStyle(RenderStyle style);
+
+        // The number of pixels that one unit of length spans at the given
+        // depth in front of the camera.
+        double pixelsPerUnit(double depth) const;
+
+        // A copy of this renderer that draws points given in a model's own
+        // coordinates, by folding modelToWorld into the camera matrix once
+        // instead of moving every point.  Its camera is in model coordinates
+        // too.  worldToModel must be the inverse of modelToWorld.
+        Renderer withModel(const Matrix& modelToWorld, const Matrix& worldToModel) const;
+
+        // Draws points and their colors.  The points are gathered and
+        // projected in batches, with projectPoints().
         template <typename ColorPointIterator>
         void renderPoint(ColorPointIterator begin, ColorPointIterator end) const {
             std::map<SDL_Color, std::vector<SDL_Point>> pointBuckets;
-            for (ColorPointIterator iter = begin; iter != end; ++iter) {
-                Point p = static_cast<Point>(*iter); // Making an explicit copy here
-                SDL_Color color = iter->color;
-
-                p = cameraMatrix * p;
-                if (p.z < 0) {
-                    continue;
+            const std::size_t batchSize = 1024;
+            Point batch[batchSize];
+            SDL_Color colors[batchSize];
+            std::uint8_t inFront[batchSize];
+            ColorPointIterator iter = begin;
+            while (iter != end) {
+                std::size_t count = 0;
+                for (; count < batchSize && iter != end; ++iter, ++count) {
+                    batch[count] = static_cast<Point>(*iter); // Making an explicit copy here
+                    colors[count] = iter->color;
                 }
-                p = projectionMatrix * p;
+                projectPoints(screenMatrix, batch, count, batch, inFront);
 
-                // Any point out of bounds of the view rectangle is skipped.
-                if (p.x < viewPortRect.x ||
-                    p.y < viewPortRect.y ||
-                    p.x >= viewPortRect.x + viewPortRect.w ||
-                    p.y >= viewPortRect.y + viewPortRect.h) {
+                for (std::size_t i = 0; i < count; i++) {
+                    const Point& p = batch[i];
+                    if (!inFront[i]) {
                         continue;
-                }
+                    }
 
-                // Render points that weren't skipped.
-                // Offset formula:
-                // width*y+x
-                if (pointBuckets.find(color) == pointBuckets.end()) {
-                    // No bucket for this color
-                    // ∴ Create the bucket
-                    pointBuckets[color] = std::vector<SDL_Point>();
+                    // Any point out of bounds of the view rectangle is skipped.
+                    if (p.x < viewPortRect.x ||
+                        p.y < viewPortRect.y ||
+                        p.x >= viewPortRect.x + viewPortRect.w ||
+                        p.y >= viewPortRect.y + viewPortRect.h) {
+                            continue;
+                    }
+
+                    // Render points that weren't skipped.
+                    // Offset formula:
+                    // width*y+x
+                    pointBuckets[colors[i]].push_back({(int)p.x, (int)p.y});
+                    // unsigned int offset = canvas->w * static_cast<unsigned int>(p.y) + static_cast<unsigned int>(p.x);
+                    // pixels[offset] = SDL_MapRGBA(canvas->format, colors[i].r, colors[i].g, colors[i].b, colors[i].a);
                 }
-                pointBuckets[color].push_back({(int)p.x, (int)p.y});
-                // unsigned int offset = canvas->w * static_cast<unsigned int>(p.y) + static_cast<unsigned int>(p.x);
-                // pixels[offset] = SDL_MapRGBA(canvas->format, color.r, color.g, color.b, color.a);
             }
 
             for (auto iter = pointBuckets.begin(); iter != pointBuckets.end(); iter++) {
@@ -70,6 +103,26 @@ class Renderer {
             }
         }
 
+        // Renders an indexed triangle mesh as a wireframe.  Every three
+        // entries of indices name one triangle's corners in vertices, and
+        // each edge is drawn in the color of the corner it starts from.
+        //
+        // Unlike renderPolygon(), this doesn't need a copy of every vertex
+        // per triangle, so a whole grid can share one vertex buffer.
+        void renderTriangles(const Point* vertices, const SDL_Color* colors,
+                             const std::vector<uint32_t>& indices) const;
+
+        // The same, but the triangles are filled and hidden surfaces are
+        // removed with the depth buffer.  Each triangle is shaded flat, in
+        // the average of its corners' colors, darkened the more it faces
+        // away from the camera.
+        //
+        // The triangles' corners are projected in batches with
+        // projectPoints() and set up in parallel, then binned into square
+        // screen tiles, and the tiles are rasterized in parallel.
+        void renderFilledTriangles(const Point* vertices, const SDL_Color* colors,
+                                   const std::vector<uint32_t>& indices) const;
+
         // Renders a set of polygons on the screen.
         template <typename PolygonIterator>
         void renderPolygon(PolygonIterator begin, PolygonIterator end) const {
@@ -154,8 +207,37 @@ class Renderer {
         Matrix cameraMatrix;
         SDL_Rect screenRect;
         Matrix projectionMatrix;
+        Matrix screenMatrix;    // projectionMatrix * cameraMatrix
         uint32_t* pixels;
 
+        RenderStyle style;
+
+        // The depth of the nearest surface drawn so far at every pixel of the
+        // canvas, as the projected z.  Copies made by withModel() draw into
+        // the same frame, so they share it.
+        std::shared_ptr<std::vector<float>> depthBuffer;
+
+        // A triangle in screen space, ready to be rasterized: its corners
+        // snapped to subpixels and wound counterclockwise on screen, their
+        // projected depths, and the pixels its bounds cover in the viewport.
+        struct RasterTriangle {
+            int64_t x[3], y[3];
+            double z[3];
+            double inverseArea;     // Of twice the triangle's area, in subpixels
+            uint32_t color;
+            int minX, minY, maxX, maxY;
+        };
+
+        // Sets up a triangle whose corners are in screen space, with their
+        // projected depth in z.  Returns false if nothing of it would be drawn.
+        bool setUpTriangle(const Point& a, const Point& b, const Point& c, uint32_t color,
+                           RasterTriangle& triangle) const;
+
+        // Fills the pixels of the triangle inside the clip rectangle, from
+        // (clipX0, clipY0) to (clipX1, clipY1) inclusive, wherever it is
+        // nearer than the depth buffer.
+        void rasterize(const RasterTriangle& triangle, int clipX0, int clipY0, int clipX1, int clipY1) const;
+
         // Draws a line from (x1, y1) to (x2, y2) in the given color.
         void drawLine(double x1, double y1, double x2, double y2, SDL_Color color) const;
 };
@@ -0,0 +1,154 @@
+#include "terrain_file.h"
+#include "grid.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+    const char terrainMagic[8] = {'A', 'L', 'T', 'T', 'E', 'R', 'R', '\0'};
+
+    size_t arrayBytes(size_t pointCount) {
+        return pointCount * (sizeof(float) + sizeof(float) + sizeof(SDL_Color));
+    }
+
+    // Writes one of the lattice's arrays, converting it a row at a time so
+    // we never hold a second full copy of the terrain in memory.
+    template <typename T, typename Source>
+    void writeArray(ofstream& out, const Grid& grid, const Source* source) {
+        const size_t rows = static_cast<size_t>(grid.rows()) + 1;
+        const size_t columns = static_cast<size_t>(grid.columns()) + 1;
+        vector<T> buffer(columns);
+        for (size_t row = 0; row < rows; row++) {
+            for (size_t column = 0; column < columns; column++) {
+                buffer[column] = source[grid.latticeIndex(row, column)];
+            }
+            out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(T));
+        }
+    }
+
+    // Hashes a file's size and modification time with FNV-1a, or returns 0
+    // if the file can't be examined.
+    uint32_t sourceStamp(const string& fileName) {
+        struct stat fileInfo;
+        if (fileName.empty() || stat(fileName.c_str(), &fileInfo) != 0) {
+            return 0;
+        }
+        const uint64_t fields[2] = {static_cast<uint64_t>(fileInfo.st_size),
+                                    static_cast<uint64_t>(fileInfo.st_mtime)};
+        uint32_t hash = 2166136261u;
+        for (uint64_t field : fields) {
+            for (int byte = 0; byte < 8; byte++) {
+                hash = (hash ^ static_cast<uint8_t>(field >> (8 * byte))) * 16777619u;
+            }
+        }
+        // 0 is kept for caches without a source.
+        return hash != 0 ? hash : 1;
+    }
+}
+
+TerrainFile::TerrainFile(const string& fileName) : file_(fileName), header_(nullptr) {
+    if (file_.size() < sizeof(TerrainFileHeader)) {
+        throw runtime_error(fileName + " is too small to be a terrain file");
+    }
+    header_ = reinterpret_cast<const TerrainFileHeader*>(file_.begin());
+    if (memcmp(header_->magic, terrainMagic, sizeof(terrainMagic)) != 0) {
+        throw runtime_error(fileName + " is not a terrain file");
+    }
+    if (header_->version != terrainFileVersion) {
+        throw runtime_error(fileName + " is terrain file version " + to_string(header_->version) +
+                            ", but we only understand version " + to_string(terrainFileVersion));
+    }
+    if (header_->rows < 1 || header_->columns < 1 ||
+        file_.size() != sizeof(TerrainFileHeader) + arrayBytes(pointCount())) {
+        throw runtime_error(fileName + " is truncated or has bad dimensions");
+    }
+}
+
+int TerrainFile::rows() const {
+    return header_->rows;
+}
+
+int TerrainFile::columns() const {
+    return header_->columns;
+}
+
+double TerrainFile::cellSize() const {
+    return header_->cellSize;
+}
+
+Basis TerrainFile::system() const {
+    const double* b = header_->basis;
+    return Basis(Point(b[0], b[1], b[2]),
+                 Vector(b[3], b[4], b[5]),
+                 Vector(b[6], b[7], b[8]),
+                 Vector(b[9], b[10], b[11]));
+}
+
+size_t TerrainFile::pointCount() const {
+    return static_cast<size_t>(header_->rows + 1) * static_cast<size_t>(header_->columns + 1);
+}
+
+const float* TerrainFile::heights() const {
+    return reinterpret_cast<const float*>(file_.begin() + sizeof(TerrainFileHeader));
+}
+
+const float* TerrainFile::slopes() const {
+    return heights() + pointCount();
+}
+
+const SDL_Color* TerrainFile::colors() const {
+    return reinterpret_cast<const SDL_Color*>(slopes() + pointCount());
+}
+
+bool TerrainFile::isStaleFor(const string& sourceFileName) const {
+    const uint32_t stamp = sourceStamp(sourceFileName);
+    return stamp != 0 && stamp != header_->sourceStamp;
+}
+
+void writeTerrainFile(const string& fileName, const Grid& grid, const string& sourceFileName) {
+    TerrainFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, terrainMagic, sizeof(terrainMagic));
+    header.version = terrainFileVersion;
+    header.rows = static_cast<int32_t>(grid.rows());
+    header.columns = static_cast<int32_t>(grid.columns());
+    header.sourceStamp = sourceStamp(sourceFileName);
+    header.cellSize = grid.cellSize();
+
+    const Basis system = grid.system();
+    const double basis[12] = {
+        system.center.x, system.center.y, system.center.z,
+        system.axisX.x, system.axisX.y, system.axisX.z,
+        system.axisY.x, system.axisY.y, system.axisY.z,
+        system.axisZ.x, system.axisZ.y, system.axisZ.z
+    };
+    memcpy(header.basis, basis, sizeof(basis));
+
+    const string temporaryFileName = fileName + ".partial";
+    {
+        ofstream out(temporaryFileName, ios::binary | ios::trunc);
+        if (!out) {
+            throw runtime_error("Could not create " + temporaryFileName);
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeArray<float>(out, grid, grid.heights());
+        writeArray<float>(out, grid, grid.slopes());
+        writeArray<SDL_Color>(out, grid, grid.colors());
+        if (!out) {
+            throw runtime_error("Could not write " + temporaryFileName);
+        }
+    }
+
+    if (rename(temporaryFileName.c_str(), fileName.c_str()) != 0) {
+        remove(temporaryFileName.c_str());
+        throw runtime_error("Could not rename " + temporaryFileName + " to " + fileName);
+    }
+}
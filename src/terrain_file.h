@@ -0,0 +1,73 @@
+#ifndef TERRAIN_FILE_H_INCLUDED
+#define TERRAIN_FILE_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+
+#include "SDL.h"
+#include "basis.h"
+#include "mapped_file.h"
+
+class Grid;
+
+// Bump this whenever the layout below changes; older caches are then
+// rejected and rebuilt from the CSV.
+const std::uint32_t terrainFileVersion = 1;
+
+// The fixed-size header at the start of every .terrain file.  It is followed
+// by three contiguous arrays, each with one entry per lattice point in
+// row-major order:
+//
+//   float     heights[(rows + 1) * (columns + 1)];
+//   float     slopes[(rows + 1) * (columns + 1)];
+//   SDL_Color colors[(rows + 1) * (columns + 1)];
+//
+// Everything is stored in the host's native byte order.
+struct TerrainFileHeader {
+    char magic[8];          // "ALTTERR" followed by a NUL
+    std::uint32_t version;  // terrainFileVersion
+    std::int32_t rows;
+    std::int32_t columns;
+    std::uint32_t sourceStamp;  // The source file's size and modification time, hashed; 0 if none
+    double cellSize;
+    double basis[12];       // center, axisX, axisY, axisZ
+};
+
+// A read-only, memory-mapped .terrain file.  Opening one only validates the
+// header; the arrays are paged in by the operating system as they are read.
+class TerrainFile {
+    public:
+        // Throws std::runtime_error if the file is missing, truncated, or
+        // was written by an incompatible version.
+        explicit TerrainFile(const std::string& fileName);
+
+        int rows() const;
+        int columns() const;
+        double cellSize() const;
+        Basis system() const;
+
+        // The number of lattice points, and so the length of each array.
+        std::size_t pointCount() const;
+
+        const float* heights() const;
+        const float* slopes() const;
+        const SDL_Color* colors() const;
+
+        // Whether the source file the cache was built from has changed since,
+        // so the cache should be rebuilt.  A source that no longer exists
+        // leaves the cache as the only copy, so it doesn't count as changed.
+        bool isStaleFor(const std::string& sourceFileName) const;
+
+    private:
+        MappedFile file_;
+        const TerrainFileHeader* header_;
+};
+
+// Saves the grid's heights, slopes and colors as a .terrain file.  The file is
+// written under a temporary name and renamed into place, so readers never see
+// a partial cache.  When the grid was imported from sourceFileName, the cache
+// remembers that file's current state for isStaleFor().
+void writeTerrainFile(const std::string& fileName, const Grid& grid,
+                      const std::string& sourceFileName = "");
+
+#endif // TERRAIN_FILE_H_INCLUDED
@@ -0,0 +1,423 @@
+#include "terrain_lod.h"
+#include "grid.h"
+#include "render.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+using namespace std;
+
+namespace {
+    // The vertex positions along a chunk edge of the given extent when only
+    // every step-th vertex is kept.  The far end is always included, so that
+    // partial chunks at the edge of the grid still close up.
+    vector<int> edgePositions(int step, int extent) {
+        vector<int> positions;
+        for (int position = 0; position < extent; position += step) {
+            positions.push_back(position);
+        }
+        positions.push_back(extent);
+        return positions;
+    }
+
+    // A vertex on a polyline, with its position along the polyline's axis.
+    struct EdgeVertex {
+        int position;
+        uint32_t index;
+    };
+}
+
+TerrainLod::TerrainLod(int chunkSize)
+    : chunkSize_(chunkSize), maxLevel_(0), chunkRows_(0), chunkColumns_(0), frame(0) {
+    while ((1 << maxLevel_) < chunkSize_) {
+        maxLevel_++;
+    }
+}
+
+void TerrainLod::build(const Grid& grid) {
+    const int rows = static_cast<int>(grid.rows());
+    const int columns = static_cast<int>(grid.columns());
+    chunkRows_ = (rows + chunkSize_ - 1) / chunkSize_;
+    chunkColumns_ = (columns + chunkSize_ - 1) / chunkSize_;
+    chunks.assign(static_cast<size_t>(chunkRows_) * chunkColumns_, Chunk());
+
+    // Chunks are measured independently, so rows of them can go in parallel.
+    getThreadPool().parallelFor(0, chunkRows_, [&] (int firstChunkRow, int lastChunkRow) {
+        for (int chunkRow = firstChunkRow; chunkRow < lastChunkRow; chunkRow++) {
+            for (int chunkColumn = 0; chunkColumn < chunkColumns_; chunkColumn++) {
+                Chunk& chunk = chunks[chunkRow * chunkColumns_ + chunkColumn];
+                chunk.row0 = chunkRow * chunkSize_;
+                chunk.column0 = chunkColumn * chunkSize_;
+                chunk.rows = min(chunkSize_, rows - chunk.row0);
+                chunk.columns = min(chunkSize_, columns - chunk.column0);
+                measureChunk(grid, chunk);
+            }
+        }
+    });
+
+    nodes.clear();
+    if (!chunks.empty()) {
+        nodes.push_back(Node());
+        buildNode(0, 0, 0, chunkRows_, chunkColumns_);
+    }
+    levels.assign(chunks.size(), maxLevel_);
+    visible.assign(chunks.size(), false);
+    screenScale.assign(chunks.size(), 0);
+    vertexStamp.assign(grid.latticeSize(), 0);
+    frame = 0;
+}
+
+void TerrainLod::measureChunk(const Grid& grid, Chunk& chunk) const {
+    const double* heights = grid.heights();
+    auto height = [&grid, &chunk, heights] (int row, int column) {
+        return heights[grid.latticeIndex(chunk.row0 + row, chunk.column0 + column)];
+    };
+
+    // Measure how far each lattice point is from the surface that a
+    // coarser level would draw in its place.
+    chunk.error.assign(maxLevel_ + 1, 0);
+    for (int level = 1; level <= maxLevel_; level++) {
+        const vector<int> rowPositions = edgePositions(1 << level, chunk.rows);
+        const vector<int> columnPositions = edgePositions(1 << level, chunk.columns);
+        double worst = chunk.error[level - 1];
+        size_t i = 0;
+        for (int row = 0; row <= chunk.rows; row++) {
+            while (i + 2 < rowPositions.size() && rowPositions[i + 1] <= row) {
+                i++;
+            }
+            const int r0 = rowPositions[i];
+            const int r1 = rowPositions[i + 1];
+            const double t = double(row - r0) / (r1 - r0);
+            size_t j = 0;
+            for (int column = 0; column <= chunk.columns; column++) {
+                while (j + 2 < columnPositions.size() && columnPositions[j + 1] <= column) {
+                    j++;
+                }
+                const int c0 = columnPositions[j];
+                const int c1 = columnPositions[j + 1];
+                const double s = double(column - c0) / (c1 - c0);
+                const double top = height(r0, c0) + s * (height(r0, c1) - height(r0, c0));
+                const double bottom = height(r1, c0) + s * (height(r1, c1) - height(r1, c0));
+                worst = max(worst, abs(height(row, column) - (top + t * (bottom - top))));
+            }
+        }
+        chunk.error[level] = worst;
+    }
+
+    // Bound the chunk in the grid's own coordinates.
+    Point low(numeric_limits<double>::max(), numeric_limits<double>::max(), numeric_limits<double>::max());
+    Point high(numeric_limits<double>::lowest(), numeric_limits<double>::lowest(), numeric_limits<double>::lowest());
+    for (int row = 0; row <= chunk.rows; row++) {
+        for (int column = 0; column <= chunk.columns; column++) {
+            const Point& p = grid.positions()[grid.latticeIndex(chunk.row0 + row, chunk.column0 + column)];
+            low = Point(min(low.x, p.x), min(low.y, p.y), min(low.z, p.z));
+            high = Point(max(high.x, p.x), max(high.y, p.y), max(high.z, p.z));
+        }
+    }
+    chunk.center = low + (high - low) / 2;
+    chunk.radius = (high - low).magnitude() / 2;
+}
+
+void TerrainLod::update(const Grid& grid, const GridRegion& region) {
+    if (region.empty() || chunks.empty()) {
+        return;
+    }
+
+    // Lattice points on a chunk boundary belong to the chunks on both sides.
+    const int firstChunkRow = max(0, (region.row0 - 1) / chunkSize_);
+    const int lastChunkRow = min(chunkRows_ - 1, region.row1 / chunkSize_);
+    const int firstChunkColumn = max(0, (region.column0 - 1) / chunkSize_);
+    const int lastChunkColumn = min(chunkColumns_ - 1, region.column1 / chunkSize_);
+    for (int chunkRow = firstChunkRow; chunkRow <= lastChunkRow; chunkRow++) {
+        for (int chunkColumn = firstChunkColumn; chunkColumn <= lastChunkColumn; chunkColumn++) {
+            measureChunk(grid, chunks[chunkRow * chunkColumns_ + chunkColumn]);
+        }
+    }
+    refitNode(0);
+}
+
+void TerrainLod::buildNode(int node, int chunkRow0, int chunkColumn0, int chunkRows, int chunkColumns) {
+    if (chunkRows == 1 && chunkColumns == 1) {
+        const int chunk = chunkRow0 * chunkColumns_ + chunkColumn0;
+        nodes[node] = Node{chunks[chunk].center, chunks[chunk].radius, -1, chunk};
+        return;
+    }
+
+    // Split into (up to) four quadrants.  Empty quadrants still get a node
+    // so that children are always four consecutive entries.
+    const int topRows = (chunkRows + 1) / 2;
+    const int leftColumns = (chunkColumns + 1) / 2;
+    const int quadrants[4][4] = {
+        {chunkRow0, chunkColumn0, topRows, leftColumns},
+        {chunkRow0, chunkColumn0 + leftColumns, topRows, chunkColumns - leftColumns},
+        {chunkRow0 + topRows, chunkColumn0, chunkRows - topRows, leftColumns},
+        {chunkRow0 + topRows, chunkColumn0 + leftColumns, chunkRows - topRows, chunkColumns - leftColumns}
+    };
+
+    const int firstChild = static_cast<int>(nodes.size());
+    nodes.resize(nodes.size() + 4, Node{Point(), -1, -1, -1});
+    for (int i = 0; i < 4; i++) {
+        if (quadrants[i][2] > 0 && quadrants[i][3] > 0) {
+            buildNode(firstChild + i, quadrants[i][0], quadrants[i][1], quadrants[i][2], quadrants[i][3]);
+        }
+    }
+
+    nodes[node].firstChild = firstChild;
+    fitNode(node);
+}
+
+void TerrainLod::refitNode(int node) {
+    const Node& n = nodes[node];
+    if (n.firstChild >= 0) {
+        for (int i = 0; i < 4; i++) {
+            refitNode(n.firstChild + i);
+        }
+    }
+    fitNode(node);
+}
+
+void TerrainLod::fitNode(int node) {
+    Node& n = nodes[node];
+    if (n.firstChild < 0) {
+        if (n.chunk >= 0) {
+            n.center = chunks[n.chunk].center;
+            n.radius = chunks[n.chunk].radius;
+        }
+        return;
+    }
+
+    // The parent's sphere encloses its children's spheres.
+    Point low(numeric_limits<double>::max(), numeric_limits<double>::max(), numeric_limits<double>::max());
+    Point high(numeric_limits<double>::lowest(), numeric_limits<double>::lowest(), numeric_limits<double>::lowest());
+    for (int i = 0; i < 4; i++) {
+        const Node& child = nodes[n.firstChild + i];
+        if (child.radius < 0) {
+            continue;
+        }
+        low = Point(min(low.x, child.center.x - child.radius), min(low.y, child.center.y - child.radius),
+                    min(low.z, child.center.z - child.radius));
+        high = Point(max(high.x, child.center.x + child.radius), max(high.y, child.center.y + child.radius),
+                     max(high.z, child.center.z + child.radius));
+    }
+    n.center = low + (high - low) / 2;
+    n.radius = (high - low).magnitude() / 2;
+}
+
+void TerrainLod::cull(int node, const Basis& camera, const Renderer& r) {
+    const Node& n = nodes[node];
+    if (n.radius < 0) {
+        return;
+    }
+
+    // Skip anything entirely behind the camera.
+    const double depth = dotProduct(n.center - camera.center, normalize(camera.axisZ));
+    if (depth < -n.radius) {
+        return;
+    }
+
+    if (n.firstChild < 0) {
+        visible[n.chunk] = true;
+        screenScale[n.chunk] = r.pixelsPerUnit(max(0.0, depth - n.radius));
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        cull(n.firstChild + i, camera, r);
+    }
+}
+
+size_t TerrainLod::chooseLevels(double pixelTolerance) {
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++) {
+        int level = maxLevel_;
+        if (visible[chunk]) {
+            while (level > 0 && chunks[chunk].error[level] * screenScale[chunk] > pixelTolerance) {
+                level--;
+            }
+        }
+        levels[chunk] = level;
+    }
+
+    // Refine chunks until no two neighbors differ by more than one level.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int chunkRow = 0; chunkRow < chunkRows_; chunkRow++) {
+            for (int chunkColumn = 0; chunkColumn < chunkColumns_; chunkColumn++) {
+                int& level = levels[chunkRow * chunkColumns_ + chunkColumn];
+                const int neighbors[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+                for (const auto& offset : neighbors) {
+                    const int row = chunkRow + offset[0];
+                    const int column = chunkColumn + offset[1];
+                    if (row < 0 || row >= chunkRows_ || column < 0 || column >= chunkColumns_) {
+                        continue;
+                    }
+                    const int neighborLevel = levels[row * chunkColumns_ + column];
+                    if (level > neighborLevel + 1) {
+                        level = neighborLevel + 1;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    size_t triangles = 0;
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++) {
+        if (visible[chunk]) {
+            const int step = 1 << levels[chunk];
+            triangles += 2 * static_cast<size_t>((chunks[chunk].rows + step - 1) / step) *
+                         ((chunks[chunk].columns + step - 1) / step);
+        }
+    }
+    return triangles;
+}
+
+void TerrainLod::select(const Grid& grid, const Renderer& r, size_t triangleBudget, double pixelTolerance) {
+    fill(visible.begin(), visible.end(), false);
+    if (!nodes.empty()) {
+        cull(0, r.getCamera(), r);
+    }
+
+    // Loosen the tolerance until the frame fits the budget.
+    double tolerance = pixelTolerance;
+    for (int attempt = 0; attempt < 32 && chooseLevels(tolerance) > triangleBudget; attempt++) {
+        tolerance *= 1.5;
+    }
+
+    if (++frame == 0) {
+        // The stamp wrapped around, so old stamps could look current.
+        fill(vertexStamp.begin(), vertexStamp.end(), 0);
+        frame = 1;
+    }
+    indices_.clear();
+    vertices_.clear();
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++) {
+        if (visible[chunk]) {
+            emitChunk(grid, static_cast<int>(chunk));
+        }
+    }
+}
+
+const vector<uint32_t>& TerrainLod::indices() const {
+    return indices_;
+}
+
+const vector<uint32_t>& TerrainLod::vertices() const {
+    return vertices_;
+}
+
+void TerrainLod::emitTriangle(uint32_t a, uint32_t b, uint32_t c) {
+    for (uint32_t index : {a, b, c}) {
+        indices_.push_back(index);
+        if (vertexStamp[index] != frame) {
+            vertexStamp[index] = frame;
+            vertices_.push_back(index);
+        }
+    }
+}
+
+void TerrainLod::emitChunk(const Grid& grid, int chunkIndex) {
+    const Chunk& chunk = chunks[chunkIndex];
+    const int chunkRow = chunkIndex / chunkColumns_;
+    const int chunkColumn = chunkIndex % chunkColumns_;
+    const int level = levels[chunkIndex];
+    const int step = 1 << level;
+
+    // An edge that borders a coarser chunk has to use that chunk's vertices.
+    auto edgeStep = [&] (int row, int column) {
+        if (row < 0 || row >= chunkRows_ || column < 0 || column >= chunkColumns_) {
+            return step;
+        }
+        return levels[row * chunkColumns_ + column] > level ? 2 * step : step;
+    };
+    const int topStep = edgeStep(chunkRow - 1, chunkColumn);
+    const int bottomStep = edgeStep(chunkRow + 1, chunkColumn);
+    const int leftStep = edgeStep(chunkRow, chunkColumn - 1);
+    const int rightStep = edgeStep(chunkRow, chunkColumn + 1);
+
+    auto index = [&grid, &chunk] (int row, int column) {
+        return static_cast<uint32_t>(grid.latticeIndex(chunk.row0 + row, chunk.column0 + column));
+    };
+    auto quad = [this, &index] (int r0, int c0, int r1, int c1) {
+        // The same split as Grid::facetize().
+        emitTriangle(index(r0, c0), index(r0, c1), index(r1, c0));
+        emitTriangle(index(r1, c1), index(r0, c1), index(r1, c0));
+    };
+    auto rowLine = [&index] (int row, const vector<int>& columns, size_t first, size_t last) {
+        vector<EdgeVertex> line;
+        for (size_t i = first; i <= last; i++) {
+            line.push_back(EdgeVertex{columns[i], index(row, columns[i])});
+        }
+        return line;
+    };
+    auto columnLine = [&index] (int column, const vector<int>& rows, size_t first, size_t last) {
+        vector<EdgeVertex> line;
+        for (size_t i = first; i <= last; i++) {
+            line.push_back(EdgeVertex{rows[i], index(rows[i], column)});
+        }
+        return line;
+    };
+    // Triangulates the strip between two roughly parallel polylines by
+    // always advancing along whichever one is behind.
+    auto zipper = [this] (const vector<EdgeVertex>& a, const vector<EdgeVertex>& b) {
+        size_t i = 0, j = 0;
+        while (i + 1 < a.size() || j + 1 < b.size()) {
+            const bool advanceA = j + 1 == b.size() ||
+                (i + 1 < a.size() && a[i].position + a[i + 1].position <= b[j].position + b[j + 1].position);
+            if (advanceA) {
+                emitTriangle(a[i].index, a[i + 1].index, b[j].index);
+                i++;
+            } else {
+                emitTriangle(a[i].index, b[j + 1].index, b[j].index);
+                j++;
+            }
+        }
+    };
+
+    const vector<int> rows = edgePositions(step, chunk.rows);
+    const vector<int> columns = edgePositions(step, chunk.columns);
+    const size_t rowCells = rows.size() - 1;
+    const size_t columnCells = columns.size() - 1;
+    const bool stitched = topStep != step || bottomStep != step || leftStep != step || rightStep != step;
+
+    if (!stitched) {
+        for (size_t i = 0; i < rowCells; i++) {
+            for (size_t j = 0; j < columnCells; j++) {
+                quad(rows[i], columns[j], rows[i + 1], columns[j + 1]);
+            }
+        }
+    } else if (rowCells == 1) {
+        // A single strip of cells: zip the top edge to the bottom edge.
+        const vector<int> top = edgePositions(topStep, chunk.columns);
+        const vector<int> bottom = edgePositions(bottomStep, chunk.columns);
+        zipper(rowLine(0, top, 0, top.size() - 1), rowLine(chunk.rows, bottom, 0, bottom.size() - 1));
+    } else if (columnCells == 1) {
+        const vector<int> left = edgePositions(leftStep, chunk.rows);
+        const vector<int> right = edgePositions(rightStep, chunk.rows);
+        zipper(columnLine(0, left, 0, left.size() - 1), columnLine(chunk.columns, right, 0, right.size() - 1));
+    } else {
+        // Regular cells inside, and a ring of stitched strips around them.
+        // Each strip runs between one outer edge and the matching edge of
+        // the inner rectangle; the four strips meet along its diagonals.
+        for (size_t i = 1; i + 1 < rowCells; i++) {
+            for (size_t j = 1; j + 1 < columnCells; j++) {
+                quad(rows[i], columns[j], rows[i + 1], columns[j + 1]);
+            }
+        }
+        const int innerTop = rows[1];
+        const int innerBottom = rows[rowCells - 1];
+        const int innerLeft = columns[1];
+        const int innerRight = columns[columnCells - 1];
+
+        const vector<int> top = edgePositions(topStep, chunk.columns);
+        zipper(rowLine(0, top, 0, top.size() - 1), rowLine(innerTop, columns, 1, columnCells - 1));
+        const vector<int> bottom = edgePositions(bottomStep, chunk.columns);
+        zipper(rowLine(chunk.rows, bottom, 0, bottom.size() - 1), rowLine(innerBottom, columns, 1, columnCells - 1));
+        const vector<int> left = edgePositions(leftStep, chunk.rows);
+        zipper(columnLine(0, left, 0, left.size() - 1), columnLine(innerLeft, rows, 1, rowCells - 1));
+        const vector<int> right = edgePositions(rightStep, chunk.rows);
+        zipper(columnLine(chunk.columns, right, 0, right.size() - 1), columnLine(innerRight, rows, 1, rowCells - 1));
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef TERRAIN_LOD_H_INCLUDED
+#define TERRAIN_LOD_H_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+#include "basis.h"
+#include "point.h"
+
+class Grid;
+class Renderer;
+struct GridRegion;
+
+// Level of detail for grid rendering by geomipmapping.
+//
+// The lattice is cut into square chunks of chunkSize cells.  Each chunk can
+// be drawn at mip level L, which keeps only every 2^L-th row and column.
+// Every frame, each chunk picks the coarsest level whose worst height error,
+// projected onto the screen, stays under a pixel tolerance.  The tolerance is
+// loosened until the whole frame fits a triangle budget, so the cost per frame
+// depends on what is on screen rather than on the size of the terrain.
+//
+// Neighboring chunks never differ by more than one level.  The edges of a
+// chunk that borders a coarser chunk are stitched to the coarser chunk's
+// vertices, so the mesh has no cracks.
+class TerrainLod {
+    public:
+        // chunkSize must be a power of two.
+        explicit TerrainLod(int chunkSize = 32);
+
+        // Measures every chunk's error at every level.  This must be called
+        // whenever the grid's heights or dimensions change.
+        void build(const Grid& grid);
+
+        // Re-measures only the chunks that touch the given lattice points,
+        // after their heights changed.  The grid's dimensions must not have
+        // changed since build().
+        void update(const Grid& grid, const GridRegion& region);
+
+        // Picks a level for every chunk as seen from the renderer's camera,
+        // and regenerates the triangle list.
+        void select(const Grid& grid, const Renderer& r, std::size_t triangleBudget,
+                    double pixelTolerance = 2.0);
+
+        // The selected triangles, as triplets of lattice indices.
+        const std::vector<std::uint32_t>& indices() const;
+
+        // The lattice indices used by the selected triangles, each listed once.
+        const std::vector<std::uint32_t>& vertices() const;
+
+    private:
+        struct Chunk {
+            int row0, column0;           // The chunk's first lattice row and column
+            int rows, columns;           // The chunk's size in cells
+            std::vector<double> error;   // The worst height error at each level
+            Point center;                // World-space bounding sphere
+            double radius;
+        };
+
+        // A node of the quadtree over the chunks, used to skip whole regions
+        // that are behind the camera.
+        struct Node {
+            Point center;
+            double radius;
+            int firstChild;              // Index of the first of four children, or -1 for a leaf
+            int chunk;                   // The chunk of a leaf
+        };
+
+        int chunkSize_;
+        int maxLevel_;
+        int chunkRows_;
+        int chunkColumns_;
+        std::vector<Chunk> chunks;
+        std::vector<Node> nodes;
+
+        // Per-frame state.
+        std::vector<int> levels;
+        std::vector<bool> visible;
+        std::vector<double> screenScale; // Pixels of error per unit of height error, per chunk
+        std::vector<std::uint32_t> indices_;
+        std::vector<std::uint32_t> vertices_;
+        std::vector<std::uint32_t> vertexStamp;
+        std::uint32_t frame;
+
+        // Measures a chunk's errors and bounding sphere from the lattice.
+        void measureChunk(const Grid& grid, Chunk& chunk) const;
+
+        // Fills in nodes[node] and its descendants for a rectangle of chunks.
+        void buildNode(int node, int chunkRow0, int chunkColumn0, int chunkRows, int chunkColumns);
+
+        // Recomputes the bounding spheres of nodes[node] and its descendants.
+        void refitNode(int node);
+
+        // Sets a node's sphere to enclose its chunk or its children's spheres.
+        void fitNode(int node);
+        void cull(int node, const Basis& camera, const Renderer& r);
+        std::size_t chooseLevels(double pixelTolerance);
+        void emitChunk(const Grid& grid, int chunk);
+        void emitTriangle(std::uint32_t a, std::uint32_t b, std::uint32_t c);
+};
+
+#endif // TERRAIN_LOD_H_INCLUDED
@@ -0,0 +1,260 @@
+#include "terrain_pager.h"
+#include "matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+using namespace std;
+
+TerrainPager::TerrainPager(const string& terrainFileName, int tileSize, size_t memoryBudget,
+                           int residentRadius, double lookaheadFrames, TileStorage storage)
+    : terrain_(terrainFileName),
+      tileSize_(tileSize),
+      memoryBudget_(memoryBudget),
+      residentRadius_(residentRadius),
+      lookaheadFrames_(lookaheadFrames),
+      storage_(storage),
+      stopping_(false),
+      residentBytes_(0),
+      changeCount_(0),
+      loading_(-1),
+      cameraTileRow_(0),
+      cameraTileColumn_(0) {
+    tileRows_ = (terrain_.rows() + tileSize_ - 1) / tileSize_;
+    tileColumns_ = (terrain_.columns() + tileSize_ - 1) / tileSize_;
+
+    // The first tile is never cut short by the terrain's edge, so it is as
+    // big as any tile gets.
+    const int side = 2 * residentRadius_ + 1;
+    const size_t mostWanted = min(2 * static_cast<size_t>(side) * side, static_cast<size_t>(tileRows_) * tileColumns_);
+    if (mostWanted * tileBytes(0) > memoryBudget_) {
+        throw runtime_error("A terrain pager memory budget of " + to_string(memoryBudget_) +
+                            " bytes can't hold the " + to_string(mostWanted) + " tiles it may need at once, which take " +
+                            to_string(mostWanted * tileBytes(0)) + " bytes");
+    }
+
+    const Basis system = terrain_.system();
+    worldToTerrain_ = cameraTransform(system.axisX, system.axisY, system.axisZ, system.center);
+
+    loader_ = thread(&TerrainPager::loaderLoop, this);
+}
+
+TerrainPager::~TerrainPager() {
+    {
+        lock_guard<mutex> guard(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    loader_.join();
+}
+
+const TerrainFile& TerrainPager::terrain() const {
+    return terrain_;
+}
+
+pair<double, double> TerrainPager::tileLocation(Point p) const {
+    // Lattice row 0 and column 0 sit half the terrain's size away from its center.
+    Point local = worldToTerrain_ * p;
+    double column = local.x / terrain_.cellSize() + terrain_.columns() / 2.0;
+    double row = local.z / terrain_.cellSize() + terrain_.rows() / 2.0;
+    return make_pair(row / tileSize_, column / tileSize_);
+}
+
+void TerrainPager::update(Point cameraPosition, Vector velocity) {
+    auto [cameraRow, cameraColumn] = tileLocation(cameraPosition);
+    auto [aheadRow, aheadColumn] = tileLocation(cameraPosition + velocity * lookaheadFrames_);
+
+    // Tiles around the camera come first, nearest first, followed by the
+    // prefetched tiles around where the camera is heading.
+    vector<pair<double, int>> nearby;
+    vector<pair<double, int>> ahead;
+    unordered_set<int> wanted;
+    auto gather = [this, &wanted] (double centerRow, double centerColumn, vector<pair<double, int>>& into) {
+        const int row0 = static_cast<int>(floor(centerRow));
+        const int column0 = static_cast<int>(floor(centerColumn));
+        for (int row = row0 - residentRadius_; row <= row0 + residentRadius_; row++) {
+            for (int column = column0 - residentRadius_; column <= column0 + residentRadius_; column++) {
+                if (row < 0 || row >= tileRows_ || column < 0 || column >= tileColumns_) {
+                    continue;
+                }
+                const int tile = row * tileColumns_ + column;
+                if (wanted.insert(tile).second) {
+                    double distance = hypot(row + 0.5 - centerRow, column + 0.5 - centerColumn);
+                    into.emplace_back(distance, tile);
+                }
+            }
+        }
+        sort(into.begin(), into.end());
+    };
+    gather(cameraRow, cameraColumn, nearby);
+    gather(aheadRow, aheadColumn, ahead);
+
+    {
+        lock_guard<mutex> guard(mutex_);
+        cameraTileRow_ = cameraRow;
+        cameraTileColumn_ = cameraColumn;
+        wanted_ = move(wanted);
+        queue_.clear();
+        for (const auto* list : {&nearby, &ahead}) {
+            for (const auto& entry : *list) {
+                const int tile = entry.second;
+                if (tile != loading_ && resident_.find(tile) == resident_.end()) {
+                    queue_.push_back(tile);
+                }
+            }
+        }
+    }
+    wake_.notify_one();
+}
+
+void TerrainPager::render(const Renderer& r) const {
+    // Drawing takes most of a frame, so only the list of tiles is taken
+    // under the lock, and the loader can keep handing tiles over meanwhile.
+    vector<Tile> tiles;
+    {
+        lock_guard<mutex> guard(mutex_);
+        tiles.reserve(resident_.size());
+        for (const auto& entry : resident_) {
+            tiles.push_back(entry.second);
+        }
+    }
+    for (const Tile& tile : tiles) {
+        if (tile.compact) {
+            tile.compact->render(r);
+        } else {
+            tile.grid->render(r);
+        }
+    }
+}
+
+size_t TerrainPager::residentBytes() const {
+    lock_guard<mutex> guard(mutex_);
+    return residentBytes_;
+}
+
+size_t TerrainPager::changeCount() const {
+    lock_guard<mutex> guard(mutex_);
+    return changeCount_;
+}
+
+size_t TerrainPager::tileBytes(int tile) const {
+    const int row = tile / tileColumns_;
+    const int column = tile % tileColumns_;
+    const size_t rows = min(tileSize_, terrain_.rows() - row * tileSize_);
+    const size_t columns = min(tileSize_, terrain_.columns() - column * tileSize_);
+    if (storage_ == TileStorage::Compact) {
+        return CompactTile::bytes(rows, columns, 0);
+    }
+    const size_t points = (rows + 1) * (columns + 1);
+    const size_t pointBytes = sizeof(Point) + 5 * sizeof(double) + sizeof(SDL_Color);
+    // Two triangles per cell, plus the cell's share of the height pyramid.
+    const size_t cellBytes = 2 * (sizeof(Plane) + sizeof(Vector)) + 3 * sizeof(double);
+    // Tiles of the same size share their triangle indices, so those don't count.
+    return sizeof(Grid) + points * pointBytes + rows * columns * cellBytes;
+}
+
+TerrainPager::Tile TerrainPager::loadTile(int tile) const {
+    const int row0 = (tile / tileColumns_) * tileSize_;
+    const int column0 = (tile % tileColumns_) * tileSize_;
+    const int rows = min(tileSize_, terrain_.rows() - row0);
+    const int columns = min(tileSize_, terrain_.columns() - column0);
+    if (storage_ == TileStorage::Compact) {
+        return Tile{nullptr, make_shared<CompactTile>(terrain_, row0, column0, rows, columns)};
+    }
+
+    auto grid = make_unique<Grid>(rows, columns, terrain_.cellSize());
+    const size_t sourceColumns = terrain_.columns() + 1;
+    const float* heights = terrain_.heights();
+    const float* slopes = terrain_.slopes();
+    const SDL_Color* colors = terrain_.colors();
+    for (int row = 0; row <= rows; row++) {
+        const size_t sourceRowStart = (row0 + row) * sourceColumns + column0;
+        const size_t rowStart = grid->latticeIndex(row, 0);
+        copy(heights + sourceRowStart, heights + sourceRowStart + columns + 1, grid->heights() + rowStart);
+        copy(slopes + sourceRowStart, slopes + sourceRowStart + columns + 1, grid->slopes() + rowStart);
+        copy(colors + sourceRowStart, colors + sourceRowStart + columns + 1, grid->colors() + rowStart);
+    }
+    grid->updateLattice();
+
+    // Move the tile from the origin to where it sits within the whole terrain.
+    const Basis system = terrain_.system();
+    const double cellSize = terrain_.cellSize();
+    const Point tileCenter = system.center +
+        (column0 + columns / 2.0 - terrain_.columns() / 2.0) * cellSize * system.axisX +
+        (row0 + rows / 2.0 - terrain_.rows() / 2.0) * cellSize * system.axisZ;
+    Matrix placement(system.axisX.x, system.axisY.x, system.axisZ.x, tileCenter.x,
+                     system.axisX.y, system.axisY.y, system.axisZ.y, tileCenter.y,
+                     system.axisX.z, system.axisY.z, system.axisZ.z, tileCenter.z,
+                     0, 0, 0, 1);
+    grid->apply(placement);
+    return Tile{move(grid), nullptr};
+}
+
+vector<TerrainPager::Tile> TerrainPager::evictOverBudget(int keep) {
+    vector<Tile> evicted;
+    if (residentBytes_ <= memoryBudget_) {
+        return evicted;
+    }
+
+    // Tiles the camera no longer wants go before tiles it does; within each
+    // group the farthest tiles go first.
+    vector<tuple<bool, double, int>> candidates;
+    for (const auto& entry : resident_) {
+        const int tile = entry.first;
+        if (tile == keep) {
+            continue;
+        }
+        const double distance = hypot(tile / tileColumns_ + 0.5 - cameraTileRow_,
+                                      tile % tileColumns_ + 0.5 - cameraTileColumn_);
+        candidates.emplace_back(wanted_.count(tile) > 0, -distance, tile);
+    }
+    sort(candidates.begin(), candidates.end());
+
+    for (const auto& candidate : candidates) {
+        if (residentBytes_ <= memoryBudget_) {
+            break;
+        }
+        const int tile = get<2>(candidate);
+        auto iter = resident_.find(tile);
+        residentBytes_ -= tileBytes(tile);
+        evicted.push_back(move(iter->second));
+        resident_.erase(iter);
+    }
+    return evicted;
+}
+
+void TerrainPager::loaderLoop() {
+    while (true) {
+        int tile;
+        {
+            unique_lock<mutex> guard(mutex_);
+            wake_.wait(guard, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            tile = queue_.front();
+            queue_.pop_front();
+            loading_ = tile;
+        }
+
+        Tile loaded = loadTile(tile);
+
+        vector<Tile> evicted;
+        {
+            lock_guard<mutex> guard(mutex_);
+            loading_ = -1;
+            if (wanted_.count(tile) == 0) {
+                // The camera moved on while we were loading.
+                continue;
+            }
+            resident_[tile] = move(loaded);
+            residentBytes_ += tileBytes(tile);
+            evicted = evictOverBudget(tile);
+            changeCount_ += 1 + evicted.size();
+        }
+        // The evicted tiles are freed here, outside the lock.
+    }
+}
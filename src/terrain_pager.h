@@ -0,0 +1,130 @@
+#ifndef TERRAIN_PAGER_H_INCLUDED
+#define TERRAIN_PAGER_H_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "compact_tile.h"
+#include "grid.h"
+#include "render.h"
+#include "terrain_file.h"
+
+// How a TerrainPager keeps its resident tiles.
+enum class TileStorage {
+    // As full Grids, which are drawn with level of detail.
+    Full,
+    // As CompactTiles, which fit roughly 30 times as much terrain in the
+    // same memory budget.
+    Compact
+};
+
+// Streams a terrain that is too large to hold in memory, one square tile at a
+// time, from a .terrain cache.
+//
+// Call update() every frame with the camera's position and velocity.  The
+// pager keeps the tiles around the camera resident, prefetches the tiles the
+// camera is heading towards on a background thread, and evicts the farthest
+// tiles whenever the resident tiles exceed the memory budget.
+class TerrainPager {
+    public:
+        // - terrainFileName: the .terrain cache to stream from
+        // - tileSize: the number of lattice cells along each side of a tile
+        // - memoryBudget: the most memory, in bytes, that resident tiles may use
+        // - residentRadius: how many tiles around the camera to keep loaded
+        // - lookaheadFrames: how many frames ahead to extrapolate the camera's
+        //   velocity when deciding what to prefetch
+        // - storage: how the resident tiles are kept
+        //
+        // Throws std::runtime_error if the memory budget can't hold every
+        // tile that update() may want at once: the (2 * residentRadius + 1)^2
+        // tiles around the camera and as many again ahead of it.  Otherwise
+        // wanted tiles would be evicted and reloaded forever.
+        TerrainPager(const std::string& terrainFileName, int tileSize = 64,
+                     std::size_t memoryBudget = 256 * 1024 * 1024, int residentRadius = 2,
+                     double lookaheadFrames = 30, TileStorage storage = TileStorage::Full);
+        ~TerrainPager();
+
+        TerrainPager(const TerrainPager&) = delete;
+        TerrainPager& operator=(const TerrainPager&) = delete;
+
+        // The terrain's size and placement, as stored in the cache.
+        const TerrainFile& terrain() const;
+
+        // Requests the tiles around cameraPosition and around where velocity
+        // (in units per frame) will take the camera.  Never blocks on disk.
+        void update(Point cameraPosition, Vector velocity);
+
+        // Renders every tile that is currently resident.
+        void render(const Renderer& r) const;
+
+        // The estimated memory used by the resident tiles, in bytes.
+        std::size_t residentBytes() const;
+
+        // Counts every tile that has become resident or been evicted.  When
+        // it changes, the resident tiles need drawing again.
+        std::size_t changeCount() const;
+
+    private:
+        // A resident tile, in whichever form storage_ asks for.  Tiles are
+        // shared so that render() can draw them outside the lock; a tile
+        // evicted meanwhile is freed once it has been drawn.
+        struct Tile {
+            std::shared_ptr<const Grid> grid;
+            std::shared_ptr<const CompactTile> compact;
+        };
+
+        TerrainFile terrain_;
+        const int tileSize_;
+        const std::size_t memoryBudget_;
+        const int residentRadius_;
+        const double lookaheadFrames_;
+        const TileStorage storage_;
+        int tileRows_;
+        int tileColumns_;
+
+        // Maps world space onto the terrain's lattice.
+        Matrix worldToTerrain_;
+
+        // Everything below is shared with the loader thread and guarded by mutex_.
+        mutable std::mutex mutex_;
+        std::condition_variable wake_;
+        bool stopping_;
+        std::deque<int> queue_;                 // Tiles to load, most urgent first
+        std::unordered_set<int> wanted_;        // Tiles the camera currently needs
+        std::unordered_map<int, Tile> resident_;
+        std::size_t residentBytes_;
+        std::size_t changeCount_;
+        int loading_;                           // The tile being loaded, or -1
+        double cameraTileRow_;
+        double cameraTileColumn_;
+
+        std::thread loader_;
+
+        void loaderLoop();
+
+        // Builds a tile from the mapped cache.  Reading the mapped arrays is
+        // what pulls the tile in from disk, so this only runs on the loader thread.
+        Tile loadTile(int tile) const;
+
+        // The memory a tile of the given id takes once it is resident.
+        std::size_t tileBytes(int tile) const;
+
+        // Evicts tiles, farthest from the camera first, until the resident
+        // tiles fit the budget again.  Called with mutex_ held; the evicted
+        // tiles are handed back so they can be freed after unlocking.
+        std::vector<Tile> evictOverBudget(int keep);
+
+        // The (fractional) tile coordinates of a point in world space.
+        std::pair<double, double> tileLocation(Point p) const;
+};
+
+#endif // TERRAIN_PAGER_H_INCLUDED
@@ -0,0 +1,331 @@
+#include "terrain_resampler.h"
+#include "thread_pool.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+using namespace std;
+
+const double lunarRadius = 1737400;
+
+PolarPosition projectSouthPolar(double latitudeDeg, double longitudeDeg) {
+    // The pole itself (latitude -90) maps to the origin, and the distance from
+    // the origin grows with the tangent of the half-angle away from the pole.
+    const double rho = 2 * lunarRadius * tan(M_PI / 4 + latitudeDeg * deg_to_rad / 2);
+    const double longitudeRad = longitudeDeg * deg_to_rad;
+    return PolarPosition{rho * sin(longitudeRad), rho * cos(longitudeRad)};
+}
+
+namespace {
+    const int noNeighbor = -1;
+
+    vector<PolarPosition> projectAll(const vector<LunarSample>& samples) {
+        vector<PolarPosition> positions(samples.size());
+        getThreadPool().parallelFor(0, static_cast<int>(samples.size()), [&] (int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                positions[i] = projectSouthPolar(samples[i].latitude, samples[i].longitude);
+            }
+        });
+        return positions;
+    }
+
+    // The working state of one resampling run.  Every array has one entry per
+    // lattice point in row-major order.
+    struct Resampler {
+        const vector<LunarSample>& samples;
+        const vector<PolarPosition>& positions;
+        Grid& grid;
+        const int rows;
+        const int columns;
+        const int stride;
+
+        // Row bands.  Band b covers rows [bandStart[b], bandStart[b + 1]).
+        int bandCount;
+        vector<int> bandStart;
+        vector<int> bandOfRow;
+
+        vector<double> heights;
+        vector<double> slopes;
+        vector<uint32_t> counts;
+
+        Resampler(const vector<LunarSample>& samples_, const vector<PolarPosition>& positions_, Grid& grid_)
+            : samples(samples_), positions(positions_), grid(grid_),
+              rows(static_cast<int>(grid_.rows()) + 1),
+              columns(static_cast<int>(grid_.columns()) + 1),
+              stride(columns) {
+            bandCount = min<int>(getThreadPool().size(), rows);
+            bandStart.resize(bandCount + 1);
+            bandOfRow.resize(rows);
+            for (int band = 0; band <= bandCount; band++) {
+                bandStart[band] = static_cast<int>(static_cast<long long>(rows) * band / bandCount);
+            }
+            for (int band = 0; band < bandCount; band++) {
+                fill(bandOfRow.begin() + bandStart[band], bandOfRow.begin() + bandStart[band + 1], band);
+            }
+            const size_t pointCount = static_cast<size_t>(rows) * columns;
+            heights.assign(pointCount, 0);
+            slopes.assign(pointCount, 0);
+            counts.assign(pointCount, 0);
+        }
+
+        // Runs work(band) for every row band, one band per thread.
+        template <typename Work>
+        void forEachBand(Work work) {
+            getThreadPool().parallelFor(0, bandCount, [&work] (int begin, int end) {
+                for (int band = begin; band < end; band++) {
+                    work(band);
+                }
+            });
+        }
+
+        // Bins every sample into its nearest lattice point and averages each bin.
+        void bin() {
+            const size_t sampleCount = samples.size();
+
+            // Pass 1: find each sample's lattice point and count how many
+            // samples each chunk of the input sends to each row band.
+            vector<int> pointOf(sampleCount);
+            vector<size_t> histogram(static_cast<size_t>(bandCount) * bandCount, 0);
+            auto chunkStart = [sampleCount, this] (int chunk) {
+                return sampleCount * chunk / bandCount;
+            };
+            forEachBand([&] (int chunk) {
+                size_t* chunkHistogram = &histogram[static_cast<size_t>(chunk) * bandCount];
+                for (size_t i = chunkStart(chunk); i < chunkStart(chunk + 1); i++) {
+                    // The polar plane is the world's XZ plane, so the grid's
+                    // own placement decides which lattice point is nearest.
+                    const auto [u, v, h] = grid.gridLocation(Point(positions[i].east, 0, positions[i].north));
+                    const long row = lround(u * (rows - 1));
+                    const long column = lround(v * (columns - 1));
+                    if (row < 0 || row >= rows || column < 0 || column >= columns) {
+                        pointOf[i] = noNeighbor;
+                        continue;
+                    }
+                    pointOf[i] = static_cast<int>(row * stride + column);
+                    chunkHistogram[bandOfRow[row]]++;
+                }
+            });
+
+            // Pass 2: a counting sort, so that each band gets a contiguous
+            // list of just the samples that land in its rows.
+            vector<size_t> offsets(histogram.size());
+            vector<size_t> bandSamplesStart(bandCount + 1, 0);
+            size_t total = 0;
+            for (int band = 0; band < bandCount; band++) {
+                bandSamplesStart[band] = total;
+                for (int chunk = 0; chunk < bandCount; chunk++) {
+                    offsets[static_cast<size_t>(chunk) * bandCount + band] = total;
+                    total += histogram[static_cast<size_t>(chunk) * bandCount + band];
+                }
+            }
+            bandSamplesStart[bandCount] = total;
+
+            vector<size_t> order(total);
+            forEachBand([&] (int chunk) {
+                size_t* chunkOffsets = &offsets[static_cast<size_t>(chunk) * bandCount];
+                for (size_t i = chunkStart(chunk); i < chunkStart(chunk + 1); i++) {
+                    if (pointOf[i] != noNeighbor) {
+                        order[chunkOffsets[bandOfRow[pointOf[i] / stride]]++] = i;
+                    }
+                }
+            });
+
+            // Pass 3: each band accumulates into lattice points that only it owns.
+            forEachBand([&] (int band) {
+                for (size_t k = bandSamplesStart[band]; k < bandSamplesStart[band + 1]; k++) {
+                    const size_t i = order[k];
+                    const int point = pointOf[i];
+                    heights[point] += samples[i].height;
+                    slopes[point] += samples[i].slope;
+                    counts[point]++;
+                }
+                for (size_t point = static_cast<size_t>(bandStart[band]) * stride;
+                     point < static_cast<size_t>(bandStart[band + 1]) * stride; point++) {
+                    if (counts[point] > 0) {
+                        heights[point] /= counts[point];
+                        slopes[point] /= counts[point];
+                    }
+                }
+            });
+        }
+
+        // Finds the filled lattice point closest to (row, column) by
+        // searching outwards in square rings.
+        int nearestFilled(int row, int column) const {
+            int best = noNeighbor;
+            long bestDistance = numeric_limits<long>::max();
+            const int maxRadius = max(rows, columns);
+            for (int radius = 1; radius <= maxRadius; radius++) {
+                if (static_cast<long>(radius) * radius > bestDistance) {
+                    // Everything in this ring and beyond is farther away.
+                    break;
+                }
+                for (int dr = -radius; dr <= radius; dr++) {
+                    const int r = row + dr;
+                    if (r < 0 || r >= rows) {
+                        continue;
+                    }
+                    // Interior rows of the ring only have their two end cells.
+                    const int step = (dr == -radius || dr == radius) ? 1 : 2 * radius;
+                    for (int dc = -radius; dc <= radius; dc += step) {
+                        const int c = column + dc;
+                        if (c < 0 || c >= columns || counts[r * stride + c] == 0) {
+                            continue;
+                        }
+                        const long distance = static_cast<long>(dr) * dr + static_cast<long>(dc) * dc;
+                        if (distance < bestDistance) {
+                            bestDistance = distance;
+                            best = r * stride + c;
+                        }
+                    }
+                }
+            }
+            return best;
+        }
+
+        // Writes the averaged samples into the grid and fills the holes.
+        void fillGrid(HoleFill holeFill) {
+            // For the bilinear fill, find the closest filled points to the
+            // left and right along each row, and above and below along each
+            // column, with linear scans rather than a search per hole.
+            vector<int> left, right, up, down;
+            if (holeFill == HoleFill::Bilinear) {
+                const size_t pointCount = counts.size();
+                left.resize(pointCount);
+                right.resize(pointCount);
+                up.resize(pointCount);
+                down.resize(pointCount);
+                forEachBand([&] (int band) {
+                    for (int row = bandStart[band]; row < bandStart[band + 1]; row++) {
+                        const int base = row * stride;
+                        int last = noNeighbor;
+                        for (int column = 0; column < columns; column++) {
+                            left[base + column] = last;
+                            if (counts[base + column] > 0) {
+                                last = column;
+                            }
+                        }
+                        last = noNeighbor;
+                        for (int column = columns - 1; column >= 0; column--) {
+                            right[base + column] = last;
+                            if (counts[base + column] > 0) {
+                                last = column;
+                            }
+                        }
+                    }
+                });
+                getThreadPool().parallelFor(0, columns, [&] (int begin, int end) {
+                    for (int column = begin; column < end; column++) {
+                        int last = noNeighbor;
+                        for (int row = 0; row < rows; row++) {
+                            up[row * stride + column] = last;
+                            if (counts[row * stride + column] > 0) {
+                                last = row;
+                            }
+                        }
+                        last = noNeighbor;
+                        for (int row = rows - 1; row >= 0; row--) {
+                            down[row * stride + column] = last;
+                            if (counts[row * stride + column] > 0) {
+                                last = row;
+                            }
+                        }
+                    }
+                });
+            }
+
+            double* gridHeights = grid.heights();
+            double* gridSlopes = grid.slopes();
+            forEachBand([&] (int band) {
+                for (int row = bandStart[band]; row < bandStart[band + 1]; row++) {
+                    for (int column = 0; column < columns; column++) {
+                        const int point = row * stride + column;
+                        double height = heights[point];
+                        double slope = slopes[point];
+                        if (counts[point] == 0) {
+                            bool filled = false;
+                            if (holeFill == HoleFill::Bilinear) {
+                                filled = interpolate(row, column, left[point], right[point],
+                                                     up[point], down[point], height, slope);
+                            }
+                            if (!filled) {
+                                const int nearest = nearestFilled(row, column);
+                                if (nearest != noNeighbor) {
+                                    height = heights[nearest];
+                                    slope = slopes[nearest];
+                                }
+                            }
+                        }
+                        const size_t index = grid.latticeIndex(row, column);
+                        gridHeights[index] = height;
+                        gridSlopes[index] = slope;
+                    }
+                }
+            });
+            grid.updateLattice();
+        }
+
+        // Interpolates a hole from its filled neighbors along its row and
+        // column.  Each direction is weighted by how close its neighbors
+        // are, and a direction with a neighbor on only one side just copies
+        // it at half weight.  Returns false if there are no neighbors at all.
+        bool interpolate(int row, int column, int leftColumn, int rightColumn, int upRow, int downRow,
+                         double& height, double& slope) const {
+            double heightSum = 0, slopeSum = 0, weightSum = 0;
+            auto accumulate = [&] (int before, int after, int position, auto pointAt) {
+                if (before != noNeighbor && after != noNeighbor) {
+                    const double t = double(position - before) / (after - before);
+                    const double weight = 1.0 / (after - before);
+                    const int a = pointAt(before);
+                    const int b = pointAt(after);
+                    heightSum += weight * (heights[a] + t * (heights[b] - heights[a]));
+                    slopeSum += weight * (slopes[a] + t * (slopes[b] - slopes[a]));
+                    weightSum += weight;
+                } else if (before != noNeighbor || after != noNeighbor) {
+                    const int neighbor = before != noNeighbor ? before : after;
+                    const double weight = 0.5 / abs(position - neighbor);
+                    heightSum += weight * heights[pointAt(neighbor)];
+                    slopeSum += weight * slopes[pointAt(neighbor)];
+                    weightSum += weight;
+                }
+            };
+            accumulate(leftColumn, rightColumn, column, [this, row] (int c) { return row * stride + c; });
+            accumulate(upRow, downRow, row, [this, column] (int r) { return r * stride + column; });
+            if (weightSum == 0) {
+                return false;
+            }
+            height = heightSum / weightSum;
+            slope = slopeSum / weightSum;
+            return true;
+        }
+    };
+
+    void resampleProjected(const vector<LunarSample>& samples, const vector<PolarPosition>& positions,
+                           Grid& grid, HoleFill holeFill) {
+        Resampler resampler(samples, positions, grid);
+        resampler.bin();
+        resampler.fillGrid(holeFill);
+    }
+}
+
+void resampleLunarSamples(const vector<LunarSample>& samples, Grid& grid, HoleFill holeFill) {
+    resampleProjected(samples, projectAll(samples), grid, holeFill);
+}
+
+Grid resampleLunarSamples(const vector<LunarSample>& samples, HoleFill holeFill) {
+    const vector<PolarPosition> positions = projectAll(samples);
+
+    double extent = 0;
+    for (const PolarPosition& position : positions) {
+        extent = max(extent, max(abs(position.east), abs(position.north)));
+    }
+
+    const int side = max(2, static_cast<int>(ceil(sqrt(static_cast<double>(samples.size())))));
+    const double cellSize = extent > 0 ? 2 * extent / (side - 1) : 1.0;
+    Grid grid(side - 1, side - 1, cellSize);
+    resampleProjected(samples, positions, grid, holeFill);
+    return grid;
+}
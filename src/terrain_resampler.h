@@ -0,0 +1,49 @@
+#ifndef TERRAIN_RESAMPLER_H_INCLUDED
+#define TERRAIN_RESAMPLER_H_INCLUDED
+
+#include <vector>
+
+#include "grid.h"
+#include "lunar_data.h"
+
+// The mean radius of the moon, in meters.
+extern const double lunarRadius;
+
+// How lattice points that received no samples get their values.
+enum class HoleFill {
+    // Copy the closest lattice point that did receive samples.
+    Nearest,
+    // Interpolate linearly between the closest filled points along the
+    // point's row and along its column, then blend the two.
+    Bilinear
+};
+
+// The position of a sample on the south polar stereographic plane, in meters
+// east and north of the pole.
+struct PolarPosition {
+    double east;
+    double north;
+};
+
+// Projects a lunar latitude and longitude (in degrees) onto the south polar
+// stereographic plane.
+PolarPosition projectSouthPolar(double latitudeDeg, double longitudeDeg);
+
+// Resamples irregular lunar samples onto the lattice of an existing grid.  The
+// polar plane is laid on the world's XZ plane, east along x and north along z
+// with the pole at the origin, and each sample goes to the lattice point that
+// gridLocation() puts it nearest, so the grid may be moved or rotated with
+// apply().  World units are taken to be meters.
+//
+// Each sample is binned into its nearest lattice point and the samples in a
+// bin are averaged; empty lattice points are then filled as requested.  Both
+// stages are split into row bands across the program's thread pool.
+void resampleLunarSamples(const std::vector<LunarSample>& samples, Grid& grid,
+                          HoleFill holeFill = HoleFill::Bilinear);
+
+// Creates a square grid that covers every sample with about one lattice point
+// per sample, and resamples the samples onto it.
+Grid resampleLunarSamples(const std::vector<LunarSample>& samples,
+                          HoleFill holeFill = HoleFill::Bilinear);
+
+#endif // TERRAIN_RESAMPLER_H_INCLUDED
@@ -0,0 +1,283 @@
+#include "texture_pyramid.h"
+#include "SDL_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+    const char pyramidMagic[8] = {'A', 'L', 'T', 'P', 'Y', 'R', 'M', '\0'};
+
+    int tilesAcross(int pixels, int tileSize) {
+        return (pixels + tileSize - 1) / tileSize;
+    }
+
+    // The number of levels needed to shrink the image down to a single tile.
+    int levelCount(int width, int height, int tileSize) {
+        int levels = 1;
+        while (width > tileSize || height > tileSize) {
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+            levels++;
+        }
+        return levels;
+    }
+
+    // Halves an RGBA32 image by averaging each 2x2 block.  The last row and
+    // column are repeated when a side is odd.
+    vector<uint32_t> halve(const vector<uint32_t>& pixels, int width, int height) {
+        const int newWidth = (width + 1) / 2;
+        const int newHeight = (height + 1) / 2;
+        vector<uint32_t> result(static_cast<size_t>(newWidth) * newHeight);
+        for (int y = 0; y < newHeight; y++) {
+            const size_t row0 = static_cast<size_t>(2 * y) * width;
+            const size_t row1 = static_cast<size_t>(min(2 * y + 1, height - 1)) * width;
+            for (int x = 0; x < newWidth; x++) {
+                const int x0 = 2 * x;
+                const int x1 = min(2 * x + 1, width - 1);
+                const uint32_t block[4] = {pixels[row0 + x0], pixels[row0 + x1], pixels[row1 + x0], pixels[row1 + x1]};
+                uint32_t average = 0;
+                for (int shift = 0; shift < 32; shift += 8) {
+                    uint32_t sum = 2;
+                    for (uint32_t p : block) {
+                        sum += (p >> shift) & 0xff;
+                    }
+                    average |= (sum / 4) << shift;
+                }
+                result[static_cast<size_t>(y) * newWidth + x] = average;
+            }
+        }
+        return result;
+    }
+
+    // Writes one level as padded tiles, row-major.
+    void writeLevel(ofstream& out, const vector<uint32_t>& pixels, int width, int height, int tileSize) {
+        vector<uint32_t> tile(static_cast<size_t>(tileSize) * tileSize);
+        for (int tileRow = 0; tileRow < tilesAcross(height, tileSize); tileRow++) {
+            for (int tileColumn = 0; tileColumn < tilesAcross(width, tileSize); tileColumn++) {
+                fill(tile.begin(), tile.end(), 0);
+                const int x0 = tileColumn * tileSize;
+                const int y0 = tileRow * tileSize;
+                const int columns = min(tileSize, width - x0);
+                const int rows = min(tileSize, height - y0);
+                for (int y = 0; y < rows; y++) {
+                    const uint32_t* source = &pixels[static_cast<size_t>(y0 + y) * width + x0];
+                    copy(source, source + columns, &tile[static_cast<size_t>(y) * tileSize]);
+                }
+                out.write(reinterpret_cast<const char*>(tile.data()), tile.size() * sizeof(uint32_t));
+            }
+        }
+    }
+}
+
+void buildTexturePyramid(const string& imageFileName, const string& pyramidFileName, int tileSize) {
+    if (tileSize < 1) {
+        throw runtime_error("Pyramid tiles must be at least one pixel wide");
+    }
+
+    SDL_Surface* image = IMG_Load(imageFileName.c_str());
+    if (image == nullptr) {
+        throw runtime_error(IMG_GetError());
+    }
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(image);
+    if (converted == nullptr) {
+        throw runtime_error(SDL_GetError());
+    }
+
+    int width = converted->w;
+    int height = converted->h;
+    vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+    SDL_LockSurface(converted);
+    for (int y = 0; y < height; y++) {
+        const char* row = static_cast<const char*>(converted->pixels) + static_cast<size_t>(y) * converted->pitch;
+        memcpy(&pixels[static_cast<size_t>(y) * width], row, width * sizeof(uint32_t));
+    }
+    SDL_UnlockSurface(converted);
+    SDL_FreeSurface(converted);
+
+    TexturePyramidHeader header = {};
+    memcpy(header.magic, pyramidMagic, sizeof(pyramidMagic));
+    header.version = texturePyramidVersion;
+    header.tileSize = tileSize;
+    header.width = width;
+    header.height = height;
+    header.levels = levelCount(width, height, tileSize);
+
+    // Write to a temporary file first so that an interrupted conversion never
+    // leaves a pyramid that looks valid behind.
+    const string partialFileName = pyramidFileName + ".partial";
+    {
+        ofstream out(partialFileName, ios::binary | ios::trunc);
+        if (!out) {
+            throw runtime_error("Could not create " + partialFileName);
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (uint32_t level = 0; level < header.levels; level++) {
+            writeLevel(out, pixels, width, height, tileSize);
+            if (level + 1 < header.levels) {
+                pixels = halve(pixels, width, height);
+                width = (width + 1) / 2;
+                height = (height + 1) / 2;
+            }
+        }
+        if (!out) {
+            throw runtime_error("Could not write " + partialFileName);
+        }
+    }
+    if (rename(partialFileName.c_str(), pyramidFileName.c_str()) != 0) {
+        remove(partialFileName.c_str());
+        throw runtime_error("Could not rename " + partialFileName + " to " + pyramidFileName);
+    }
+}
+
+TextureTileCache::TextureTileCache(const string& pyramidFileName, size_t memoryBudget)
+    : file_(pyramidFileName), header_(nullptr), memoryBudget_(memoryBudget), tileBytes_(0) {
+    if (file_.size() < sizeof(TexturePyramidHeader)) {
+        throw runtime_error(pyramidFileName + " is too small to be a texture pyramid");
+    }
+    header_ = reinterpret_cast<const TexturePyramidHeader*>(file_.begin());
+    if (memcmp(header_->magic, pyramidMagic, sizeof(pyramidMagic)) != 0) {
+        throw runtime_error(pyramidFileName + " is not a texture pyramid");
+    }
+    if (header_->version != texturePyramidVersion) {
+        throw runtime_error(pyramidFileName + " is texture pyramid version " + to_string(header_->version) +
+                            ", but we only understand version " + to_string(texturePyramidVersion));
+    }
+    const int tileSize = header_->tileSize;
+    if (tileSize < 1 || header_->width < 1 || header_->height < 1 ||
+        header_->levels != static_cast<uint32_t>(levelCount(header_->width, header_->height, tileSize))) {
+        throw runtime_error(pyramidFileName + " has bad dimensions");
+    }
+    tileBytes_ = static_cast<size_t>(tileSize) * tileSize * sizeof(uint32_t);
+
+    size_t tileCount = 0;
+    int width = header_->width;
+    int height = header_->height;
+    for (uint32_t level = 0; level < header_->levels; level++) {
+        Level l = {width, height, tilesAcross(height, tileSize), tilesAcross(width, tileSize), tileCount};
+        levels_.push_back(l);
+        tileCount += static_cast<size_t>(l.tileRows) * l.tileColumns;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    if (file_.size() != sizeof(TexturePyramidHeader) + tileCount * tileBytes_) {
+        throw runtime_error(pyramidFileName + " is truncated");
+    }
+}
+
+TextureTileCache::~TextureTileCache() {
+    for (auto& entry : tiles_) {
+        SDL_FreeSurface(entry.second.surface);
+    }
+}
+
+int TextureTileCache::width() const {
+    return header_->width;
+}
+
+int TextureTileCache::height() const {
+    return header_->height;
+}
+
+size_t TextureTileCache::cachedBytes() const {
+    return tiles_.size() * tileBytes_;
+}
+
+SDL_Surface* TextureTileCache::tile(int level, int tileRow, int tileColumn) {
+    const Level& l = levels_[level];
+    const size_t index = l.firstTile + static_cast<size_t>(tileRow) * l.tileColumns + tileColumn;
+
+    auto iter = tiles_.find(index);
+    if (iter != tiles_.end()) {
+        recentTiles_.splice(recentTiles_.begin(), recentTiles_, iter->second.recent);
+        return iter->second.surface;
+    }
+
+    const int tileSize = header_->tileSize;
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, tileSize, tileSize, 32, SDL_PIXELFORMAT_RGBA32);
+    if (surface == nullptr) {
+        throw runtime_error(SDL_GetError());
+    }
+    SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+
+    // Touching the mapped tile is what reads it from disk.
+    const char* source = file_.begin() + sizeof(TexturePyramidHeader) + index * tileBytes_;
+    const size_t rowBytes = tileSize * sizeof(uint32_t);
+    for (int y = 0; y < tileSize; y++) {
+        memcpy(static_cast<char*>(surface->pixels) + static_cast<size_t>(y) * surface->pitch,
+               source + y * rowBytes, rowBytes);
+    }
+
+    recentTiles_.push_front(index);
+    tiles_[index] = CachedTile{surface, recentTiles_.begin()};
+
+    // The tile we just loaded is at the front, so it is never the one evicted.
+    while (cachedBytes() > memoryBudget_ && recentTiles_.size() > 1) {
+        auto oldest = tiles_.find(recentTiles_.back());
+        SDL_FreeSurface(oldest->second.surface);
+        tiles_.erase(oldest);
+        recentTiles_.pop_back();
+    }
+    return surface;
+}
+
+void TextureTileCache::draw(SDL_Surface* screen, SDL_Rect destination, double u0, double v0, double u1, double v1) {
+    if (destination.w <= 0 || destination.h <= 0 || u1 <= u0 || v1 <= v0) {
+        return;
+    }
+
+    // Pick the coarsest level that still has a texel for every pixel.
+    const double texelsPerPixel = max((u1 - u0) * header_->height / destination.h,
+                                      (v1 - v0) * header_->width / destination.w);
+    int level = 0;
+    if (texelsPerPixel > 1) {
+        level = min(static_cast<int>(floor(log2(texelsPerPixel))), static_cast<int>(levels_.size()) - 1);
+    }
+    const Level& l = levels_[level];
+    const int tileSize = header_->tileSize;
+
+    // The region in the chosen level's pixels, and how many screen pixels
+    // each of those pixels covers.
+    const double x0 = v0 * l.width;
+    const double y0 = u0 * l.height;
+    const double scaleX = destination.w / ((v1 - v0) * l.width);
+    const double scaleY = destination.h / ((u1 - u0) * l.height);
+
+    const int firstRow = max(0, static_cast<int>(floor(y0 / tileSize)));
+    const int lastRow = min(l.tileRows - 1, static_cast<int>(floor(u1 * l.height / tileSize)));
+    const int firstColumn = max(0, static_cast<int>(floor(x0 / tileSize)));
+    const int lastColumn = min(l.tileColumns - 1, static_cast<int>(floor(v1 * l.width / tileSize)));
+
+    // Blitting whole tiles is simpler than trimming them; the clip rectangle
+    // keeps them inside the destination.
+    SDL_Rect oldClip;
+    SDL_GetClipRect(screen, &oldClip);
+    SDL_SetClipRect(screen, &destination);
+    SDL_FillRect(screen, &destination, SDL_MapRGB(screen->format, 0, 0, 0));
+    for (int tileRow = firstRow; tileRow <= lastRow; tileRow++) {
+        for (int tileColumn = firstColumn; tileColumn <= lastColumn; tileColumn++) {
+            const int tileX = tileColumn * tileSize;
+            const int tileY = tileRow * tileSize;
+            SDL_Rect source = {0, 0, min(tileSize, l.width - tileX), min(tileSize, l.height - tileY)};
+
+            // Rounding both edges (rather than the size) keeps neighboring
+            // tiles from leaving gaps between them.
+            const int left = destination.x + static_cast<int>(lround((tileX - x0) * scaleX));
+            const int top = destination.y + static_cast<int>(lround((tileY - y0) * scaleY));
+            const int right = destination.x + static_cast<int>(lround((tileX + source.w - x0) * scaleX));
+            const int bottom = destination.y + static_cast<int>(lround((tileY + source.h - y0) * scaleY));
+            SDL_Rect target = {left, top, right - left, bottom - top};
+            if (target.w <= 0 || target.h <= 0) {
+                continue;
+            }
+            SDL_BlitScaled(tile(level, tileRow, tileColumn), &source, screen, &target);
+        }
+    }
+    SDL_SetClipRect(screen, &oldClip);
+}
@@ -0,0 +1,92 @@
+#ifndef TEXTURE_PYRAMID_H_INCLUDED
+#define TEXTURE_PYRAMID_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SDL.h"
+#include "mapped_file.h"
+
+// Bump this whenever the layout below changes.
+const std::uint32_t texturePyramidVersion = 1;
+
+// The fixed-size header at the start of every .pyramid file.
+//
+// Level 0 is the source image; each following level halves the previous one,
+// down to the first level that fits in a single tile.  Every level is cut into
+// square tiles of tileSize x tileSize RGBA32 pixels, stored row-major, and the
+// levels follow each other from 0 upwards.  Tiles on the right and bottom
+// edges are padded to full size so that every tile can be found by arithmetic.
+struct TexturePyramidHeader {
+    char magic[8];          // "ALTPYRM" followed by a NUL
+    std::uint32_t version;  // texturePyramidVersion
+    std::uint32_t tileSize;
+    std::uint32_t width;    // Size of level 0, in pixels
+    std::uint32_t height;
+    std::uint32_t levels;
+    std::uint32_t reserved;
+};
+
+// Converts an image into a .pyramid file.  This is meant to be run offline
+// (see pyramid_tool.cpp), since it has to decode the whole source image.
+void buildTexturePyramid(const std::string& imageFileName, const std::string& pyramidFileName,
+                         int tileSize = 256);
+
+// Draws regions of a huge texture from its .pyramid file while keeping only
+// the tiles the current view needs in memory.
+//
+// Tiles are copied out of the mapped pyramid into SDL surfaces on first use,
+// and the least recently used tiles are freed once the cached tiles exceed
+// the memory budget.
+class TextureTileCache {
+    public:
+        // Throws std::runtime_error if the file isn't a valid pyramid.
+        TextureTileCache(const std::string& pyramidFileName, std::size_t memoryBudget = 64 * 1024 * 1024);
+        ~TextureTileCache();
+
+        TextureTileCache(const TextureTileCache&) = delete;
+        TextureTileCache& operator=(const TextureTileCache&) = delete;
+
+        // The size of the full-resolution texture.
+        int width() const;
+        int height() const;
+
+        // Draws the part of the texture between (u0, v0) and (u1, v1) into
+        // the destination rectangle, using the coarsest mip level that still
+        // has at least one texel per screen pixel.  u runs down the texture
+        // and v runs across it, both from 0 to 1, as in Grid::gridLocation().
+        void draw(SDL_Surface* screen, SDL_Rect destination, double u0, double v0, double u1, double v1);
+
+        // The memory used by the cached tiles, in bytes.
+        std::size_t cachedBytes() const;
+
+    private:
+        struct Level {
+            int width, height;
+            int tileRows, tileColumns;
+            std::size_t firstTile;  // Index of the level's first tile in the file
+        };
+
+        MappedFile file_;
+        const TexturePyramidHeader* header_;
+        std::vector<Level> levels_;
+        std::size_t memoryBudget_;
+        std::size_t tileBytes_;
+
+        // Least recently used tiles are at the back.
+        std::list<std::size_t> recentTiles_;
+        struct CachedTile {
+            SDL_Surface* surface;
+            std::list<std::size_t>::iterator recent;
+        };
+        std::unordered_map<std::size_t, CachedTile> tiles_;
+
+        // Returns the tile, loading it (and evicting others) if needed.
+        SDL_Surface* tile(int level, int tileRow, int tileColumn);
+};
+
+#endif // TEXTURE_PYRAMID_H_INCLUDED
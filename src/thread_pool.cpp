@@ -0,0 +1,137 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+
+using namespace std;
+
+namespace {
+    // Bookkeeping for one parallelFor() call.
+    struct LoopState {
+        mutex lock;
+        condition_variable finished;
+        int remaining;
+        exception_ptr error;
+    };
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) : stopping(false) {
+    // The calling thread always does a share of the work, so we need one fewer worker.
+    for (unsigned i = 1; i < max(threadCount, 1u); i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::size() const {
+    return static_cast<unsigned>(workers.size()) + 1;
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<std::mutex> guard(mutex);
+            taskAvailable.wait(guard, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) {
+                return;
+            }
+            task = move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+bool ThreadPool::runPendingTask() {
+    function<void()> task;
+    {
+        lock_guard<std::mutex> guard(mutex);
+        if (tasks.empty()) {
+            return false;
+        }
+        task = move(tasks.front());
+        tasks.pop_front();
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::parallelFor(int begin, int end, const function<void(int, int)>& band) {
+    const int count = end - begin;
+    if (count <= 0) {
+        return;
+    }
+    const int bands = min<int>(count, size());
+    if (bands == 1) {
+        band(begin, end);
+        return;
+    }
+
+    auto state = make_shared<LoopState>();
+    state->remaining = bands;
+
+    auto runBand = [state, &band] (int bandBegin, int bandEnd) {
+        try {
+            band(bandBegin, bandEnd);
+        } catch (...) {
+            lock_guard<std::mutex> guard(state->lock);
+            if (!state->error) {
+                state->error = current_exception();
+            }
+        }
+        lock_guard<std::mutex> guard(state->lock);
+        if (--state->remaining == 0) {
+            state->finished.notify_all();
+        }
+    };
+
+    // Band i covers [begin + count * i / bands, begin + count * (i + 1) / bands).
+    {
+        lock_guard<std::mutex> guard(mutex);
+        for (int i = 1; i < bands; i++) {
+            int bandBegin = begin + static_cast<int>(static_cast<long long>(count) * i / bands);
+            int bandEnd = begin + static_cast<int>(static_cast<long long>(count) * (i + 1) / bands);
+            tasks.emplace_back([runBand, bandBegin, bandEnd] { runBand(bandBegin, bandEnd); });
+        }
+    }
+    taskAvailable.notify_all();
+
+    runBand(begin, begin + count / bands);
+
+    // Help with whatever is still queued (possibly our own bands) rather than
+    // sleeping, then wait for bands that other threads are still running.
+    while (true) {
+        {
+            lock_guard<std::mutex> guard(state->lock);
+            if (state->remaining == 0) {
+                break;
+            }
+        }
+        if (!runPendingTask()) {
+            unique_lock<std::mutex> guard(state->lock);
+            state->finished.wait(guard, [&state] { return state->remaining == 0; });
+            break;
+        }
+    }
+
+    if (state->error) {
+        rethrow_exception(state->error);
+    }
+}
+
+ThreadPool& getThreadPool() {
+    static ThreadPool pool(thread::hardware_concurrency());
+    return pool;
+}
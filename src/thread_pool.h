@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for data-parallel loops.  The pool is shared by
+// the whole program (see getThreadPool()) so that we don't pay for thread
+// creation every time a loop runs.
+class ThreadPool {
+    public:
+        // Creates a pool that runs loops on threadCount threads in total,
+        // counting the thread that calls parallelFor().
+        explicit ThreadPool(unsigned threadCount);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // The number of threads that share the work of a loop.
+        unsigned size() const;
+
+        // Splits [begin, end) into at most size() contiguous bands and calls
+        // band(bandBegin, bandEnd) once for each, then waits for all of them.
+        // The calling thread runs a band itself, and keeps running queued
+        // bands while it waits, so nested calls can't deadlock.
+        //
+        // If any band throws, the first exception is rethrown here after all
+        // bands have finished.
+        void parallelFor(int begin, int end, const std::function<void(int, int)>& band);
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable taskAvailable;
+        bool stopping;
+
+        void workerLoop();
+
+        // Runs one queued task, if there is one.  Returns false if the queue was empty.
+        bool runPendingTask();
+};
+
+// Returns the program-wide pool, sized to the number of hardware threads.
+extern ThreadPool& getThreadPool();
+
+#endif // THREAD_POOL_H_INCLUDED
@@ -0,0 +1,139 @@
+#include "viewshed.h"
+#include "grid.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace {
+    // One eighth of the lattice around the observer.  Its points are
+    // observer + k * major + j * minor for 0 <= j <= k, where major and minor
+    // are unit steps along the lattice's rows or columns.
+    struct Octant {
+        bool majorIsRow;
+        int majorSign;
+        int minorSign;
+    };
+
+    // Sweeps an octant ring by ring, writing the visibility of the points
+    // it owns.  Points on the lines between octants are swept by both of
+    // their octants, but written by only one of them.
+    void sweepOctant(const Grid& grid, Octant octant, int observerRow, int observerColumn,
+                     double observerElevation, double targetHeight, vector<uint8_t>& visible) {
+        const int rows = static_cast<int>(grid.rows()) + 1;
+        const int columns = static_cast<int>(grid.columns()) + 1;
+        const double* heights = grid.heights();
+
+        const int majorObserver = octant.majorIsRow ? observerRow : observerColumn;
+        const int minorObserver = octant.majorIsRow ? observerColumn : observerRow;
+        const int majorSize = octant.majorIsRow ? rows : columns;
+        const int minorSize = octant.majorIsRow ? columns : rows;
+        const int majorLimit = octant.majorSign > 0 ? majorSize - 1 - majorObserver : majorObserver;
+        const int minorLimit = octant.minorSign > 0 ? minorSize - 1 - minorObserver : minorObserver;
+
+        // The horizon elevation of each point of the previous and current
+        // rings: the higher of the terrain and the line of sight over it.
+        vector<double> previous(minorLimit + 1), current(minorLimit + 1);
+        for (int k = 1; k <= majorLimit; k++) {
+            const int lastJ = min(k, minorLimit);
+            for (int j = 0; j <= lastJ; j++) {
+                const int major = majorObserver + octant.majorSign * k;
+                const int minor = minorObserver + octant.minorSign * j;
+                const int row = octant.majorIsRow ? major : minor;
+                const int column = octant.majorIsRow ? minor : major;
+                const size_t index = grid.latticeIndex(row, column);
+                const double height = heights[index];
+
+                double horizon = -INFINITY;
+                if (k > 1) {
+                    // The line of sight to this point crosses the previous
+                    // ring between two of its points.  Interpolate their
+                    // horizon there, then extend the line out to this ring.
+                    const double crossing = j * (k - 1) / double(k);
+                    const int j0 = static_cast<int>(crossing);
+                    const double fraction = crossing - j0;
+                    double crossingHorizon = previous[j0];
+                    if (fraction > 0) {
+                        crossingHorizon += fraction * (previous[j0 + 1] - previous[j0]);
+                    }
+                    horizon = observerElevation + (crossingHorizon - observerElevation) * k / (k - 1);
+                }
+                current[j] = max(height, horizon);
+
+                const bool owned = (j > 0 || octant.minorSign > 0) && (j < k || octant.majorIsRow);
+                if (owned) {
+                    visible[index] = height + targetHeight >= horizon;
+                }
+            }
+            swap(previous, current);
+        }
+    }
+}
+
+Viewshed::Viewshed() : rows_(0), columns_(0), wordsPerRow_(0) {}
+
+void Viewshed::compute(const Grid& grid, int observerRow, int observerColumn,
+                       double observerHeight, double targetHeight) {
+    rows_ = static_cast<int>(grid.rows()) + 1;
+    columns_ = static_cast<int>(grid.columns()) + 1;
+    if (observerRow < 0 || observerRow >= rows_ || observerColumn < 0 || observerColumn >= columns_) {
+        throw runtime_error("Observer at (" + to_string(observerRow) + ", " + to_string(observerColumn) +
+                            ") is outside the grid");
+    }
+    wordsPerRow_ = (columns_ + 63) / 64;
+    visible_.assign(grid.latticeSize(), 0);
+    bits_.assign(static_cast<size_t>(rows_) * wordsPerRow_, 0);
+
+    const size_t observerIndex = grid.latticeIndex(observerRow, observerColumn);
+    const double observerElevation = grid.heights()[observerIndex] + observerHeight;
+    visible_[observerIndex] = 1;
+
+    const Octant octants[8] = {
+        {true, 1, 1}, {true, 1, -1}, {true, -1, 1}, {true, -1, -1},
+        {false, 1, 1}, {false, 1, -1}, {false, -1, 1}, {false, -1, -1}
+    };
+    getThreadPool().parallelFor(0, 8, [&] (int first, int last) {
+        for (int octant = first; octant < last; octant++) {
+            sweepOctant(grid, octants[octant], observerRow, observerColumn,
+                        observerElevation, targetHeight, visible_);
+        }
+    });
+
+    // Rows of bits don't share words, so they can be packed in parallel.
+    getThreadPool().parallelFor(0, rows_, [&] (int firstRow, int lastRow) {
+        for (int row = firstRow; row < lastRow; row++) {
+            uint64_t* words = &bits_[static_cast<size_t>(row) * wordsPerRow_];
+            for (int column = 0; column < columns_; column++) {
+                words[column / 64] |= uint64_t(visible_[grid.latticeIndex(row, column)]) << (column % 64);
+            }
+        }
+    });
+}
+
+bool Viewshed::visible(int row, int column) const {
+    if (row < 0 || row >= rows_ || column < 0 || column >= columns_) {
+        return false;
+    }
+    return (bits_[static_cast<size_t>(row) * wordsPerRow_ + column / 64] >> (column % 64)) & 1;
+}
+
+size_t Viewshed::visibleCount() const {
+    size_t count = 0;
+    for (uint64_t word : bits_) {
+        count += bitset<64>(word).count();
+    }
+    return count;
+}
+
+const vector<uint64_t>& Viewshed::bits() const {
+    return bits_;
+}
+
+int Viewshed::wordsPerRow() const {
+    return wordsPerRow_;
+}
@@ -0,0 +1,53 @@
+#ifndef VIEWSHED_H_INCLUDED
+#define VIEWSHED_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Grid;
+
+// Which lattice points of a grid can be seen from an observer standing on
+// one of them, such as a lander's antenna.
+//
+// This uses XDraw (Franklin and Ray): the lattice is swept outwards from the
+// observer in square rings, and the horizon height at each point is
+// extrapolated from the two points of the previous ring that lie closest to
+// its line of sight.  That makes the whole viewshed O(N) instead of a line of
+// sight test per point, at the cost of small errors near the edges of shadows.
+// The eight octants around the observer are independent, so they are swept
+// in parallel.
+class Viewshed {
+    public:
+        Viewshed();
+
+        // Recomputes the viewshed for an observer observerHeight above the
+        // terrain at the given lattice point.  A point counts as visible if
+        // something targetHeight above the terrain there could be seen.
+        //
+        // Throws std::runtime_error if the observer is outside the grid.
+        void compute(const Grid& grid, int observerRow, int observerColumn,
+                     double observerHeight, double targetHeight = 0);
+
+        bool visible(int row, int column) const;
+
+        // The number of visible lattice points.
+        std::size_t visibleCount() const;
+
+        // The visibility of every lattice point, one bit each.  Row r starts
+        // at word r * wordsPerRow(), and column c is bit c % 64 of word
+        // c / 64 of the row.
+        const std::vector<std::uint64_t>& bits() const;
+        int wordsPerRow() const;
+
+    private:
+        int rows_, columns_;            // Lattice points, not cells
+        int wordsPerRow_;
+        std::vector<std::uint64_t> bits_;
+
+        // Visibility of each lattice point, one byte each, so that the
+        // octants can write their points without sharing words.
+        std::vector<std::uint8_t> visible_;
+};
+
+#endif // VIEWSHED_H_INCLUDED